@@ -33,18 +33,48 @@ SOFTWARE.
 #ifndef CPP_BSON_CONVERT_HPP
 #define CPP_BSON_CONVERT_HPP
 
+#include <algorithm>
+#include <array>
 #include <chrono>
 #include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory_resource>
+#include <new>
 #include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <variant>
 #include <bsoncxx/v_noabi/bsoncxx/document/view.hpp>
+#include <bsoncxx/v_noabi/bsoncxx/document/value.hpp>
+#include <bsoncxx/v_noabi/bsoncxx/array/view.hpp>
+#include <bsoncxx/v_noabi/bsoncxx/array/value.hpp>
 #include <bsoncxx/v_noabi/bsoncxx/oid.hpp>
 #include <bsoncxx/v_noabi/bsoncxx/builder/basic/document.hpp>
 #include <bsoncxx/v_noabi/bsoncxx/builder/basic/kvp.hpp>
 #include <bsoncxx/v_noabi/bsoncxx/types.hpp>
 #include <bsoncxx/v_noabi/bsoncxx/builder/basic/array.hpp>
+#include <bsoncxx/v_noabi/bsoncxx/builder/concatenate.hpp>
 #include <vector>
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// CPP_BSON_CONVERT_INSTRUMENTATION changes the bodies of the functions generated by BSON_DEFINE_TYPE, so it must
+// be defined for the whole program, not per translation unit, or types shared between them violate the ODR
+#ifdef CPP_BSON_CONVERT_INSTRUMENTATION
+#include <atomic>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#endif
+
 
 
 #pragma region typetraits
@@ -54,341 +84,3439 @@ SOFTWARE.
     {
     };
 
-    template <typename U>
-    struct is_std_vector<std::vector<U>> : std::true_type
+    template <typename U, typename Alloc>
+    struct is_std_vector<std::vector<U, Alloc>> : std::true_type
     {
     };
 
     template <typename T>
     inline constexpr bool is_std_vector_v = is_std_vector<T>::value;
 
+    template <typename T>
+    struct is_std_variant : std::false_type
+    {
+    };
+
+    template <typename... Ts>
+    struct is_std_variant<std::variant<Ts...>> : std::true_type
+    {
+    };
+
+    template <typename T>
+    inline constexpr bool is_std_variant_v = is_std_variant<T>::value;
+
     template <typename T>
     inline constexpr bool is_primitive_v = std::is_same_v<T, std::string> || std::is_arithmetic_v<T> || std::is_same_v<T, bsoncxx::v_noabi::oid>;
 
+    template <typename T>
+    inline constexpr bool is_pmr_aware_v = std::uses_allocator_v<T, std::pmr::polymorphic_allocator<std::byte>>;
+
+    template <typename T, typename = void>
+    struct has_resource_from_bson : std::false_type
+    {
+    };
+
+    template <typename T>
+    struct has_resource_from_bson<T, std::void_t<decltype(T::fromBSON(std::declval<const bsoncxx::v_noabi::document::view&>(), std::declval<std::pmr::memory_resource*>()))>> : std::true_type
+    {
+    };
+
+    template <typename T>
+    inline constexpr bool has_resource_from_bson_v = has_resource_from_bson<T>::value;
+
+    template <typename T, typename = void>
+    struct has_append_bson : std::false_type
+    {
+    };
+
+    template <typename T>
+    struct has_append_bson<T, std::void_t<decltype(T::appendBSON(std::declval<bsoncxx::v_noabi::builder::basic::document&>(), std::declval<const T&>()))>> : std::true_type
+    {
+    };
+
+    template <typename T>
+    inline constexpr bool has_append_bson_v = has_append_bson<T>::value;
+
     template <class>
     inline constexpr bool always_false_v = false;
 
 #pragma endregion
 
-#pragma region deserialize methods
+#pragma region instrumentation
+
+#ifdef CPP_BSON_CONVERT_INSTRUMENTATION
 
     /**
-     * @brief Deserialize a BSON element to a C++ type
-     * @tparam T C++ type to deserialize to
-     * @tparam Element BSON element type
-     * @param element BSON element to deserialize
-     * @return Deserialized C++ type
+     * @brief Kind of conversion reported to the instrumentation sink
      */
-    template <typename T, typename Element>
-    T get(const Element& element)
+    enum class BsonOperation
     {
-        if constexpr (std::__is_optional_v<T>)
-        {
-            if (element && element.type() != bsoncxx::v_noabi::type::k_null)
-            {
-                return get<typename T::value_type>(element);
-            }
-        }
-        else if constexpr (std::is_same_v<T, bool>)
-        {
-            return element.get_bool().value;
-        }
-        else if constexpr (std::is_same_v<T, int>)
-        {
-            return element.get_int32().value;
-        }
-        else if constexpr (std::is_same_v<T, int32_t>)
-        {
-            return element.get_int32().value;
-        }
-        else if constexpr (std::is_same_v<T, int64_t>)
-        {
-            return element.get_int64().value;
-        }
-        else if constexpr (std::is_same_v<T, double>)
-        {
-            return element.get_double().value;
-        }
-        else if constexpr (std::is_same_v<T, std::string>)
-        {
-            auto str = element.get_string().value;
-            return std::string(str);
-        }
-        else if constexpr (std::is_same_v<T, std::chrono::time_point<std::chrono::system_clock>>)
-        {
-            return element.get_date();
-        }
-        else if constexpr (std::is_same_v<T, short>)
-        {
-            return static_cast<unsigned short>(element.get_int32().value);
-        }
-        else if constexpr (std::is_same_v<T, unsigned short>)
-        {
-            return static_cast<unsigned short>(element.get_int32().value);
-        }
-        else if constexpr (is_std_vector_v<T>)
-        {
-            std::vector<typename T::value_type> vec;
-            vec.reserve(element.get_array().value.length());
-            for (const auto& el : element.get_array().value)
-            {
-                vec.emplace_back(get<typename T::value_type>(el));
-            }
-            return vec;
-        }
-        else if constexpr (std::is_same_v<T, bsoncxx::v_noabi::oid>)
-        {
-            return element.get_oid().value;
-        }
-        else if constexpr (std::is_class_v<T>)
-        {
-            return T::fromBSON(element.get_document().view());
-        }
-        else
-        {
-            static_assert(always_false_v<T>, "Unsupported type");
-        }
-
-        return T{};
-    }
+        Encode,
+        Decode
+    };
 
     /**
-     * @brief Deserialize a member from a BSON document
-     * @tparam T Type of the member
-     * @param member Member to deserialize
-     * @param doc BSON document to deserialize from
-     * @param key Key of the member in the BSON document
+     * @brief A single toBSON or fromBSON call, keyed by the class name given to BSON_DEFINE_TYPE
      */
-    template <typename T>
-    void deserializeMember(T& member, const bsoncxx::v_noabi::document::view& doc, const std::string& key)
+    struct BsonInstrumentationEvent
     {
-        auto it = doc.find(key);
-        if (it != doc.end())
-        {
-            member = get<T>(*it);
-        }
-    }
-
-#define EXPAND(x) x
-#define EVAL(...)  EVAL1024(__VA_ARGS__)
-#define EVAL1024(...) EVAL512(EVAL512(__VA_ARGS__))
-#define EVAL512(...)  EVAL256(EVAL256(__VA_ARGS__))
-#define EVAL256(...)  EVAL128(EVAL128(__VA_ARGS__))
-#define EVAL128(...)  EVAL64(EVAL64(__VA_ARGS__))
-#define EVAL64(...)   EVAL32(EVAL32(__VA_ARGS__))
-#define EVAL32(...)   EVAL16(EVAL16(__VA_ARGS__))
-#define EVAL16(...)   EVAL8(EVAL8(__VA_ARGS__))
-#define EVAL8(...)    EVAL4(EVAL4(__VA_ARGS__))
-#define EVAL4(...)    EVAL2(EVAL2(__VA_ARGS__))
-#define EVAL2(...)    EVAL1(EVAL1(__VA_ARGS__))
-#define EVAL1(...)    __VA_ARGS__
-
-#define EMPTY()
-#define DEFER(id) id EMPTY()
-#define OBSTRUCT(...) __VA_ARGS__ DEFER(EMPTY)()
+        const char* typeName;
+        BsonOperation operation;
+        std::size_t bytes;
+        std::chrono::nanoseconds latency;
+        std::uint64_t allocations;
+    };
 
-#define DESERIALIZE_MEMBER_FROM_DOC(member, doc, name) deserializeMember(instance.member, doc, name);
-#define RECURSE_FROM_BSON_INDIRECT() RECURSE_FROM_BSON
-#define RECURSE_FROM_BSON() BSON_FROM_BSON_1
+    using BsonInstrumentationSink = void (*)(const BsonInstrumentationEvent&);
 
-#define BSON_FROM_BSON_1(class_name, x, ...)      \
-DESERIALIZE_MEMBER_FROM_DOC(x, doc, #x)                          \
-__VA_OPT__(OBSTRUCT(RECURSE_FROM_BSON)()(class_name, __VA_ARGS__))
+    /// Bucket i of a latency histogram counts calls that took [2^i, 2^(i+1)) nanoseconds
+    inline constexpr std::size_t bsonLatencyBuckets = 32;
 
-#define BSON_DEFINE_FROM_BSON(class_name, ...)           \
-static class_name fromBSON(const bsoncxx::document::view& doc) { \
-class_name instance{}; \
-EVAL(BSON_FROM_BSON_1(class_name, __VA_ARGS__)) \
-return instance;                                        \
-}
+    /**
+     * @brief Aggregated counters of a single type, as returned by bsonStatsSnapshot
+     */
+    struct BsonTypeStats
+    {
+        std::uint64_t encodeCount = 0;
+        std::uint64_t decodeCount = 0;
+        std::uint64_t encodedBytes = 0;
+        std::uint64_t decodedBytes = 0;
+        std::uint64_t maxEncodedBytes = 0;
+        std::uint64_t maxDecodedBytes = 0;
+        std::uint64_t allocations = 0;
+        std::array<std::uint64_t, bsonLatencyBuckets> encodeLatency{};
+        std::array<std::uint64_t, bsonLatencyBuckets> decodeLatency{};
+    };
 
-#pragma endregion
+#ifdef CPP_BSON_CONVERT_INSTRUMENT_ALLOCATIONS
+    /// Allocations made by the current thread, bumped by the hooks of CPP_BSON_CONVERT_DEFINE_ALLOCATION_HOOKS
+    inline thread_local std::uint64_t bsonAllocationCount = 0;
 
-#pragma region serialize methods
+/**
+ * Replaces the global operator new/delete so that allocations are attributed to the type being converted.
+ * Expand it exactly once, in a single translation unit of the program.
+ */
+#define CPP_BSON_CONVERT_DEFINE_ALLOCATION_HOOKS \
+void* operator new(std::size_t size) { \
+++bsonAllocationCount; \
+if (void* ptr = std::malloc(size ? size : 1)) return ptr; \
+throw std::bad_alloc(); \
+} \
+void operator delete(void* ptr) noexcept { std::free(ptr); } \
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+#endif
 
     /**
-     * @brief Serialize a primitive member to a BSON document
-     * @tparam T Type of the member
-     * @param doc BSON document to serialize to
-     * @param key Key of the member in the BSON document
-     * @param value Value of the member
+     * @brief Per-thread counters of a single type. Only the owning thread writes them, so updates are
+     * plain relaxed load/store pairs and snapshots can read them without stopping the writer.
      */
-    template <typename T>
-    std::enable_if_t<is_primitive_v<T>> serializeMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const T& value)
+    struct BsonAtomicTypeStats
     {
-        doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, value));
-    }
+        std::atomic<std::uint64_t> encodeCount{0};
+        std::atomic<std::uint64_t> decodeCount{0};
+        std::atomic<std::uint64_t> encodedBytes{0};
+        std::atomic<std::uint64_t> decodedBytes{0};
+        std::atomic<std::uint64_t> maxEncodedBytes{0};
+        std::atomic<std::uint64_t> maxDecodedBytes{0};
+        std::atomic<std::uint64_t> allocations{0};
+        std::array<std::atomic<std::uint64_t>, bsonLatencyBuckets> encodeLatency{};
+        std::array<std::atomic<std::uint64_t>, bsonLatencyBuckets> decodeLatency{};
+    };
 
     /**
-     * @brief Serialize a time_point member to a BSON document
-     * @param doc BSON document to serialize to
-     * @param key Key of the member in the BSON document
-     * @param value Value of the member
+     * @brief Counters of all types converted by one thread. The mutex only guards the map itself, which
+     * changes the first time a thread sees a type; the counters are updated without taking it.
      */
-    inline void serializeMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const std::chrono::system_clock::time_point& value)
+    struct BsonThreadStats
     {
-        doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, bsoncxx::v_noabi::types::b_date{value}));
-    }
+        std::mutex mutex;
+        std::unordered_map<const char*, std::unique_ptr<BsonAtomicTypeStats>> types;
+    };
 
     /**
-     * @brief Serialize an optional member to a BSON document
-     * @tparam T Type of the member
-     * @param doc BSON document to serialize to
-     * @param key Key of the member in the BSON document
-     * @param value Value of the member
+     * @brief Process-wide list of per-thread counters. Entries outlive their threads so that their
+     * counts stay visible to later snapshots.
      */
-    template <typename T>
-    std::enable_if_t<is_primitive_v<T>> serializeMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const std::optional<T>& value)
+    struct BsonStatsRegistry
     {
-        if (value.has_value())
+        std::mutex mutex;
+        std::vector<std::shared_ptr<BsonThreadStats>> threads;
+
+        static BsonStatsRegistry& instance()
         {
-            doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, value.value()));
-            return;
+            static BsonStatsRegistry registry;
+            return registry;
         }
+    };
 
-        // if the field is oid, we don't add it at all so that mongodb sets it automatically
-        if (typeid(T) != typeid(bsoncxx::oid))
+    inline BsonThreadStats& bsonThreadStats()
+    {
+        thread_local std::shared_ptr<BsonThreadStats> stats = []
         {
-            doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, bsoncxx::v_noabi::types::b_null{}));
+            auto created = std::make_shared<BsonThreadStats>();
+            auto& registry = BsonStatsRegistry::instance();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.threads.push_back(created);
+            return created;
+        }();
+        return *stats;
+    }
+
+    inline void bsonStatsAdd(std::atomic<std::uint64_t>& counter, std::uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    inline void bsonStatsMax(std::atomic<std::uint64_t>& counter, std::uint64_t value)
+    {
+        if (value > counter.load(std::memory_order_relaxed))
+        {
+            counter.store(value, std::memory_order_relaxed);
         }
     }
 
-    /**
-     * @brief Serialize a primitive vector member to a BSON document
-     * @tparam T Type of the member
-     * @param doc BSON document to serialize to
-     * @param key Key of the member in the BSON document
-     * @param value Value of the member
-     */
-    template <typename T>
-    std::enable_if_t<is_primitive_v<T>> serializeMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const std::vector<T>& value)
+    inline std::size_t bsonLatencyBucket(std::chrono::nanoseconds latency)
     {
-        bsoncxx::v_noabi::builder::basic::array arr;
-        for (const auto& el : value)
+        std::size_t bucket = 0;
+        for (auto ns = static_cast<std::uint64_t>(latency.count()); ns > 1 && bucket + 1 < bsonLatencyBuckets; ns >>= 1)
         {
-            arr.append(el);
+            ++bucket;
         }
-        doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, arr));
+        return bucket;
     }
 
     /**
-     * @brief Serialize a non primitive vector member to a BSON document
-     * @tparam T Type of the member
-     * @param doc BSON document to serialize to
-     * @param key Key of the member in the BSON document
-     * @param value Value of the member
+     * @brief Default sink: records the event into the calling thread's aggregator
+     * @param event Event to record
      */
-    template <typename T>
-    std::enable_if_t<!is_primitive_v<T>> serializeMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const std::vector<T>& value)
+    inline void recordBsonStats(const BsonInstrumentationEvent& event)
     {
-        bsoncxx::v_noabi::builder::basic::array arr;
-        for (const auto& el : value)
+        auto& thread = bsonThreadStats();
+        auto it = thread.types.find(event.typeName);
+        if (it == thread.types.end())
         {
-            arr.append(T::toBSON(el).view());
+            std::lock_guard<std::mutex> lock(thread.mutex);
+            it = thread.types.emplace(event.typeName, std::make_unique<BsonAtomicTypeStats>()).first;
         }
-        doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, arr));
+
+        auto& stats = *it->second;
+        const auto bucket = bsonLatencyBucket(event.latency);
+        if (event.operation == BsonOperation::Encode)
+        {
+            bsonStatsAdd(stats.encodeCount, 1);
+            bsonStatsAdd(stats.encodedBytes, event.bytes);
+            bsonStatsMax(stats.maxEncodedBytes, event.bytes);
+            bsonStatsAdd(stats.encodeLatency[bucket], 1);
+        }
+        else
+        {
+            bsonStatsAdd(stats.decodeCount, 1);
+            bsonStatsAdd(stats.decodedBytes, event.bytes);
+            bsonStatsMax(stats.maxDecodedBytes, event.bytes);
+            bsonStatsAdd(stats.decodeLatency[bucket], 1);
+        }
+        bsonStatsAdd(stats.allocations, event.allocations);
     }
 
     /**
-     * @brief Serialize a primitive optional vector member to a BSON document
-     * @tparam T Type of the member
-     * @param doc BSON document to serialize to
-     * @param key Key of the member in the BSON document
-     * @param value Value of the member
+     * @brief Merge the counters of all threads into one entry per type name
+     * @return Aggregated counters keyed by class name
      */
-    template <typename T>
-    std::enable_if_t<is_primitive_v<T>> serializeMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const std::optional<std::vector<T>>& value)
+    inline std::map<std::string, BsonTypeStats> bsonStatsSnapshot()
     {
-        if (value.has_value())
+        std::map<std::string, BsonTypeStats> snapshot;
+        auto& registry = BsonStatsRegistry::instance();
+        std::lock_guard<std::mutex> registryLock(registry.mutex);
+        for (const auto& thread : registry.threads)
         {
-            bsoncxx::v_noabi::builder::basic::array arr;
-            for (const auto& el : value.value())
+            std::lock_guard<std::mutex> threadLock(thread->mutex);
+            for (const auto& [typeName, stats] : thread->types)
             {
-                arr.append(el);
+                auto& merged = snapshot[typeName];
+                merged.encodeCount += stats->encodeCount.load(std::memory_order_relaxed);
+                merged.decodeCount += stats->decodeCount.load(std::memory_order_relaxed);
+                merged.encodedBytes += stats->encodedBytes.load(std::memory_order_relaxed);
+                merged.decodedBytes += stats->decodedBytes.load(std::memory_order_relaxed);
+                merged.maxEncodedBytes = std::max(merged.maxEncodedBytes, stats->maxEncodedBytes.load(std::memory_order_relaxed));
+                merged.maxDecodedBytes = std::max(merged.maxDecodedBytes, stats->maxDecodedBytes.load(std::memory_order_relaxed));
+                merged.allocations += stats->allocations.load(std::memory_order_relaxed);
+                for (std::size_t i = 0; i < bsonLatencyBuckets; ++i)
+                {
+                    merged.encodeLatency[i] += stats->encodeLatency[i].load(std::memory_order_relaxed);
+                    merged.decodeLatency[i] += stats->decodeLatency[i].load(std::memory_order_relaxed);
+                }
             }
-            doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, arr));
-            return;
         }
-
-        doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, bsoncxx::v_noabi::types::b_null{}));
+        return snapshot;
     }
 
     /**
-     * @brief Serialize a non primitive optional vector member to a BSON document
-     * @tparam T Type of the member
-     * @param doc BSON document to serialize to
-     * @param key Key of the member in the BSON document
-     * @param value Value of the member
+     * @brief Drop all aggregated counters. Calls that are in flight on other threads may still be counted.
      */
-    template <typename T>
-    std::enable_if_t<!is_primitive_v<T>> serializeMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const std::optional<std::vector<T>>& value)
+    inline void resetBsonStats()
     {
-        if (value.has_value())
+        auto& registry = BsonStatsRegistry::instance();
+        std::lock_guard<std::mutex> registryLock(registry.mutex);
+        for (const auto& thread : registry.threads)
         {
-            bsoncxx::v_noabi::builder::basic::array arr;
-            for (const auto& el : value.value())
+            std::lock_guard<std::mutex> threadLock(thread->mutex);
+            for (auto& [typeName, stats] : thread->types)
             {
-                arr.append(T::toBSON(el).view());
+                for (auto* counter : {&stats->encodeCount, &stats->decodeCount, &stats->encodedBytes, &stats->decodedBytes,
+                                      &stats->maxEncodedBytes, &stats->maxDecodedBytes, &stats->allocations})
+                {
+                    counter->store(0, std::memory_order_relaxed);
+                }
+                for (std::size_t i = 0; i < bsonLatencyBuckets; ++i)
+                {
+                    stats->encodeLatency[i].store(0, std::memory_order_relaxed);
+                    stats->decodeLatency[i].store(0, std::memory_order_relaxed);
+                }
             }
-            doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, arr));
-            return;
         }
-        doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, bsoncxx::v_noabi::types::b_null{}));
+    }
+
+    inline std::atomic<BsonInstrumentationSink>& bsonInstrumentationSink()
+    {
+        static std::atomic<BsonInstrumentationSink> sink{&recordBsonStats};
+        return sink;
     }
 
     /**
-     * @brief Serialize a class member to a BSON document
-     * @tparam T Type of the member
-     * @param doc BSON document to serialize to
-     * @param key Key of the member in the BSON document
-     * @param value Value of the member
+     * @brief Route instrumentation events to a custom sink
+     * @param sink Callback invoked once per toBSON/fromBSON call, or nullptr to stop recording
      */
-    template <typename T>
-    std::enable_if_t<!is_primitive_v<T> && !is_std_vector_v<T> && !std::__is_optional_v<T>> serializeMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const T& value)
+    inline void setBsonInstrumentationSink(BsonInstrumentationSink sink)
     {
-        doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, T::toBSON(value).view()));
+        bsonInstrumentationSink().store(sink, std::memory_order_release);
     }
 
     /**
-     * @brief Serialize an optional member to a BSON document
-     * @tparam T Type of the member
+     * @brief Measures one toBSON/fromBSON call and reports it to the current sink when it goes out of scope
+     */
+    class BsonInstrumentationScope
+    {
+    public:
+        BsonInstrumentationScope(const char* typeName, BsonOperation operation, std::size_t bytes = 0)
+            : sink_(bsonInstrumentationSink().load(std::memory_order_acquire)), typeName_(typeName), operation_(operation), bytes_(bytes)
+        {
+            if (sink_)
+            {
+#ifdef CPP_BSON_CONVERT_INSTRUMENT_ALLOCATIONS
+                allocations_ = bsonAllocationCount;
+#endif
+                start_ = std::chrono::steady_clock::now();
+            }
+        }
+
+        BsonInstrumentationScope(const BsonInstrumentationScope&) = delete;
+        BsonInstrumentationScope& operator=(const BsonInstrumentationScope&) = delete;
+
+        ~BsonInstrumentationScope()
+        {
+            if (!sink_)
+            {
+                return;
+            }
+
+            const auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_);
+            std::uint64_t allocations = 0;
+#ifdef CPP_BSON_CONVERT_INSTRUMENT_ALLOCATIONS
+            allocations = bsonAllocationCount - allocations_;
+#endif
+            sink_({typeName_, operation_, bytes_, latency, allocations});
+        }
+
+        void bytes(std::size_t bytes)
+        {
+            bytes_ = bytes;
+        }
+
+    private:
+        BsonInstrumentationSink sink_;
+        const char* typeName_;
+        BsonOperation operation_;
+        std::size_t bytes_;
+        std::uint64_t allocations_ = 0;
+        std::chrono::steady_clock::time_point start_{};
+    };
+
+#define BSON_INSTRUMENT_DECODE(class_name, doc) BsonInstrumentationScope bsonInstrumentation{#class_name, BsonOperation::Decode, doc.length()};
+#define BSON_INSTRUMENT_ENCODE(class_name) BsonInstrumentationScope bsonInstrumentation{#class_name, BsonOperation::Encode};
+#define BSON_INSTRUMENT_ENCODED_BYTES(value) bsonInstrumentation.bytes(value.view().length());
+
+#else
+
+#define BSON_INSTRUMENT_DECODE(class_name, doc)
+#define BSON_INSTRUMENT_ENCODE(class_name)
+#define BSON_INSTRUMENT_ENCODED_BYTES(value)
+
+#endif
+
+#pragma endregion
+
+#pragma region enums
+
+    /**
+     * @brief Name of a single enumerator, as declared with BSON_DEFINE_ENUM
+     */
+    template <typename E>
+    struct BsonEnumEntry
+    {
+        E value;
+        std::string_view name;
+    };
+
+    struct BsonEnumTableBegin
+    {
+    };
+
+    template <typename E, typename... Entries>
+    constexpr std::array<BsonEnumEntry<E>, sizeof...(Entries)> makeBsonEnumTable(BsonEnumTableBegin, Entries... entries)
+    {
+        return {{entries...}};
+    }
+
+    template <typename E, typename = void>
+    struct has_bson_enum_table : std::false_type
+    {
+    };
+
+    template <typename E>
+    struct has_bson_enum_table<E, std::void_t<decltype(bsonEnumTable(std::declval<E>()))>> : std::true_type
+    {
+    };
+
+    template <typename E>
+    inline constexpr bool has_bson_enum_table_v = has_bson_enum_table<E>::value;
+
+    constexpr std::uint32_t bsonEnumHash(std::string_view name, std::uint32_t seed)
+    {
+        std::uint32_t hash = 2166136261u ^ (seed * 0x9E3779B9u);
+        for (const auto c : name)
+        {
+            hash = (hash ^ static_cast<std::uint8_t>(c)) * 16777619u;
+        }
+        return hash ^ (hash >> 15);
+    }
+
+    constexpr std::size_t bsonNextPowerOfTwo(std::size_t value)
+    {
+        std::size_t result = 1;
+        while (result < value)
+        {
+            result *= 2;
+        }
+        return result;
+    }
+
+    /**
+     * @brief Perfect hash of the enumerator names of an enum: a name is first hashed to a bucket, and the
+     * seed stored for that bucket hashes it to a slot that no other name uses.
+     */
+    template <std::size_t N>
+    struct BsonEnumIndex
+    {
+        static constexpr std::size_t slotCount = bsonNextPowerOfTwo(2 * N);
+        static constexpr std::size_t bucketCount = slotCount / 2;
+
+        std::array<std::uint32_t, bucketCount> seeds{};
+        std::array<std::uint16_t, slotCount> slots{}; // entry index + 1, 0 when empty
+    };
+
+    /**
+     * @brief Whether a list of enumerator names or document keys holds the same string twice
+     * @param names Names to check
+     * @return True if two names are equal
+     */
+    template <std::size_t N>
+    constexpr bool bsonHasDuplicateKeys(const std::array<std::string_view, N>& names)
+    {
+        for (std::size_t i = 0; i < N; ++i)
+        {
+            for (std::size_t j = i + 1; j < N; ++j)
+            {
+                if (names[i] == names[j])
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Build the perfect hash of an enum name table at compile time, placing the largest buckets first
+     * @param table Enumerator names declared with BSON_DEFINE_ENUM
+     * @return Index mapping every name to its entry
+     */
+    template <typename E, std::size_t N>
+    constexpr BsonEnumIndex<N> makeBsonEnumIndex(const std::array<BsonEnumEntry<E>, N>& table)
+    {
+        using Index = BsonEnumIndex<N>;
+        Index index{};
+
+        std::array<std::string_view, N> names{};
+        for (std::size_t i = 0; i < N; ++i)
+        {
+            names[i] = table[i].name;
+        }
+        if (bsonHasDuplicateKeys(names))
+        {
+            throw std::invalid_argument("duplicate enum name");
+        }
+
+        std::array<std::size_t, N> bucketOf{};
+        std::array<std::size_t, Index::bucketCount> bucketSizes{};
+        for (std::size_t i = 0; i < N; ++i)
+        {
+            bucketOf[i] = bsonEnumHash(table[i].name, 0) & (Index::bucketCount - 1);
+            ++bucketSizes[bucketOf[i]];
+        }
+
+        std::array<bool, Index::bucketCount> placed{};
+        for (std::size_t round = 0; round < Index::bucketCount; ++round)
+        {
+            std::size_t bucket = 0;
+            for (std::size_t b = 0; b < Index::bucketCount; ++b)
+            {
+                if (!placed[b] && (placed[bucket] || bucketSizes[b] > bucketSizes[bucket]))
+                {
+                    bucket = b;
+                }
+            }
+            placed[bucket] = true;
+            if (bucketSizes[bucket] == 0)
+            {
+                break;
+            }
+
+            for (std::uint32_t seed = 1;; ++seed)
+            {
+                auto slots = index.slots;
+                bool fits = true;
+                for (std::size_t i = 0; i < N && fits; ++i)
+                {
+                    if (bucketOf[i] == bucket)
+                    {
+                        const auto slot = bsonEnumHash(table[i].name, seed) & (Index::slotCount - 1);
+                        fits = slots[slot] == 0;
+                        slots[slot] = static_cast<std::uint16_t>(i + 1);
+                    }
+                }
+                if (fits)
+                {
+                    index.slots = slots;
+                    index.seeds[bucket] = seed;
+                    break;
+                }
+            }
+        }
+        return index;
+    }
+
+    /**
+     * @brief Look up a name in a table through its perfect hash
+     * @param table Names and their values
+     * @param index Perfect hash of the names, built with makeBsonEnumIndex
+     * @param name Name to look up
+     * @return Entry with this name, or nullptr if there is none
+     */
+    template <typename E, std::size_t N>
+    const BsonEnumEntry<E>* findBsonEnumEntry(const std::array<BsonEnumEntry<E>, N>& table, const BsonEnumIndex<N>& index, std::string_view name)
+    {
+        using Index = BsonEnumIndex<N>;
+
+        const auto bucket = bsonEnumHash(name, 0) & (Index::bucketCount - 1);
+        const auto slot = index.slots[bsonEnumHash(name, index.seeds[bucket]) & (Index::slotCount - 1)];
+        if (slot == 0 || table[slot - 1].name != name)
+        {
+            return nullptr;
+        }
+        return &table[slot - 1];
+    }
+
+    /**
+     * @brief Look up an enumerator by its name
+     * @tparam E Enum type declared with BSON_DEFINE_ENUM
+     * @param name Name to look up
+     * @return Enumerator with this name
+     */
+    template <typename E>
+    E bsonEnumFromName(std::string_view name)
+    {
+        static constexpr auto table = bsonEnumTable(E{});
+        static constexpr auto index = makeBsonEnumIndex(table);
+
+        const auto* entry = findBsonEnumEntry(table, index, name);
+        if (entry == nullptr)
+        {
+            throw std::invalid_argument("unknown enum name");
+        }
+        return entry->value;
+    }
+
+    /**
+     * @brief Look up the name of an enumerator
+     * @tparam E Enum type declared with BSON_DEFINE_ENUM
+     * @param value Enumerator to look up
+     * @return Name of the enumerator
+     */
+    template <typename E>
+    std::string_view bsonEnumName(E value)
+    {
+        static constexpr auto table = bsonEnumTable(E{});
+        static constexpr bool dense = []
+        {
+            for (std::size_t i = 0; i < table.size(); ++i)
+            {
+                if (static_cast<std::size_t>(table[i].value) != i)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }();
+
+        if constexpr (dense)
+        {
+            const auto i = static_cast<std::size_t>(value);
+            if (i < table.size())
+            {
+                return table[i].name;
+            }
+        }
+        else
+        {
+            for (const auto& entry : table)
+            {
+                if (entry.value == value)
+                {
+                    return entry.name;
+                }
+            }
+        }
+        throw std::invalid_argument("enum value has no name");
+    }
+
+    /**
+     * @brief Convert an enumerator to the value stored in BSON: its name if the enum is declared with
+     * BSON_DEFINE_ENUM, its integer value otherwise
+     * @tparam E Enum type
+     * @param value Enumerator to convert
+     * @return String view or int32 to append to a builder
+     */
+    template <typename E>
+    auto bsonEnumValue(E value)
+    {
+        if constexpr (has_bson_enum_table_v<E>)
+        {
+            const auto name = bsonEnumName(value);
+            return bsoncxx::v_noabi::stdx::string_view(name.data(), name.size());
+        }
+        else
+        {
+            return static_cast<std::int32_t>(value);
+        }
+    }
+
+#define BSON_ENUM_ENTRY(enum_name, x) , BsonEnumEntry<enum_name>{enum_name::x, #x}
+#define RECURSE_ENUM_ENTRIES() BSON_ENUM_ENTRIES_1
+
+#define BSON_ENUM_ENTRIES_1(enum_name, x, ...) \
+BSON_ENUM_ENTRY(enum_name, x) \
+__VA_OPT__(OBSTRUCT(RECURSE_ENUM_ENTRIES)()(enum_name, __VA_ARGS__))
+
+/**
+ * Declares the names under which the enumerators of an enum are stored, making it serialize as strings
+ * instead of int32. Use it in the namespace of the enum.
+ */
+#define BSON_DEFINE_ENUM(enum_name, ...) \
+constexpr auto bsonEnumTable(enum_name) { \
+return makeBsonEnumTable<enum_name>(BsonEnumTableBegin{} EVAL(BSON_ENUM_ENTRIES_1(enum_name, __VA_ARGS__))); \
+}
+
+#pragma endregion
+
+#pragma region raw documents
+
+    /**
+     * @brief Owned copy of the raw bytes of a sub-document or array, passed through without being decoded.
+     * Decoding copies the bytes of the element with one memcpy and encoding appends them verbatim.
+     * A default constructed BsonRawDocument holds an empty document.
+     */
+    class BsonRawDocument
+    {
+    public:
+        BsonRawDocument() = default;
+
+        explicit BsonRawDocument(const bsoncxx::v_noabi::document::view& doc) : bytes_(doc.data(), doc.data() + doc.length())
+        {
+        }
+
+        explicit BsonRawDocument(const bsoncxx::v_noabi::array::view& arr) : bytes_(arr.data(), arr.data() + arr.length()), isArray_(true)
+        {
+        }
+
+        /**
+         * @return Whether the bytes hold a BSON array rather than a document
+         */
+        bool isArray() const
+        {
+            return isArray_;
+        }
+
+        /**
+         * @return View of the bytes as a document, valid as long as this object
+         */
+        bsoncxx::v_noabi::document::view view() const
+        {
+            if (bytes_.empty())
+            {
+                return bsoncxx::v_noabi::document::view();
+            }
+            return bsoncxx::v_noabi::document::view(bytes_.data(), bytes_.size());
+        }
+
+        /**
+         * @return View of the bytes as an array, valid as long as this object
+         */
+        bsoncxx::v_noabi::array::view arrayView() const
+        {
+            if (bytes_.empty())
+            {
+                return bsoncxx::v_noabi::array::view();
+            }
+            return bsoncxx::v_noabi::array::view(bytes_.data(), bytes_.size());
+        }
+
+        const std::uint8_t* data() const
+        {
+            return bytes_.empty() ? view().data() : bytes_.data();
+        }
+
+        std::size_t size() const
+        {
+            return bytes_.empty() ? view().length() : bytes_.size();
+        }
+
+    private:
+        std::vector<std::uint8_t> bytes_;
+        bool isArray_ = false;
+    };
+
+    template <typename T>
+    inline constexpr bool is_bson_raw_v = std::is_same_v<T, BsonRawDocument>
+        || std::is_same_v<T, bsoncxx::v_noabi::document::view> || std::is_same_v<T, bsoncxx::v_noabi::document::value>
+        || std::is_same_v<T, bsoncxx::v_noabi::array::view> || std::is_same_v<T, bsoncxx::v_noabi::array::value>;
+
+#pragma endregion
+
+#pragma region fixed layout
+
+    /**
+     * @brief Key and pointer to member of a member declared with BSON_DEFINE_TYPE
+     */
+    template <typename Class, typename Member>
+    struct BsonMember
+    {
+        using type = Member;
+
+        const char* key;
+        Member Class::* pointer;
+    };
+
+    template <typename Class, typename Member>
+    constexpr BsonMember<Class, Member> bsonMember(const char* key, Member Class::* pointer)
+    {
+        return {key, pointer};
+    }
+
+    struct BsonMembersBegin
+    {
+    };
+
+    template <typename... Members>
+    constexpr auto makeBsonMembers(BsonMembersBegin, Members... members)
+    {
+        return std::make_tuple(members...);
+    }
+
+    template <typename T, typename = void>
+    struct has_bson_members : std::false_type
+    {
+    };
+
+    template <typename T>
+    struct has_bson_members<T, std::void_t<decltype(T::bsonMembers())>> : std::true_type
+    {
+    };
+
+    template <typename T>
+    inline constexpr bool has_bson_members_v = has_bson_members<T>::value;
+
+    /**
+     * @brief Size of the BSON value of a member type whose encoding always has the same size
+     * @return Size in bytes, or 0 if the size depends on the value
+     */
+    template <typename T>
+    constexpr std::size_t bsonFixedWidth()
+    {
+        if constexpr (std::is_same_v<T, bool>)
+        {
+            return 1;
+        }
+        else if constexpr (std::is_same_v<T, int32_t>)
+        {
+            return 4;
+        }
+        else if constexpr (std::is_enum_v<T>)
+        {
+            return has_bson_enum_table_v<T> ? 0 : 4;
+        }
+        else if constexpr (std::is_same_v<T, int64_t> || std::is_same_v<T, double> || std::is_same_v<T, std::chrono::system_clock::time_point>)
+        {
+            return 8;
+        }
+        else if constexpr (std::is_same_v<T, bsoncxx::v_noabi::oid>)
+        {
+            return 12;
+        }
+        else
+        {
+            return 0;
+        }
+    }
+
+    template <typename T>
+    constexpr bsoncxx::v_noabi::type bsonFixedType()
+    {
+        if constexpr (std::is_same_v<T, bool>)
+        {
+            return bsoncxx::v_noabi::type::k_bool;
+        }
+        else if constexpr (std::is_same_v<T, int32_t> || std::is_enum_v<T>)
+        {
+            return bsoncxx::v_noabi::type::k_int32;
+        }
+        else if constexpr (std::is_same_v<T, int64_t>)
+        {
+            return bsoncxx::v_noabi::type::k_int64;
+        }
+        else if constexpr (std::is_same_v<T, double>)
+        {
+            return bsoncxx::v_noabi::type::k_double;
+        }
+        else if constexpr (std::is_same_v<T, std::chrono::system_clock::time_point>)
+        {
+            return bsoncxx::v_noabi::type::k_date;
+        }
+        else
+        {
+            return bsoncxx::v_noabi::type::k_oid;
+        }
+    }
+
+    /**
+     * @brief Whether every member of a type defined with BSON_DEFINE_TYPE has a fixed-width encoding, so that
+     * its documents only differ in their value bytes
+     */
+    template <typename T>
+    constexpr bool bsonIsFixedLayout()
+    {
+        if constexpr (has_bson_members_v<T>)
+        {
+            return std::apply([](auto... members)
+            {
+                return sizeof...(members) > 0 && ((bsonFixedWidth<typename decltype(members)::type>() > 0) && ...);
+            }, T::bsonMembers());
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    /**
+     * @brief Pre-encoded document of a fixed-layout type: keys, type tags and length header, with the offset of
+     * every value
+     */
+    template <std::size_t N>
+    struct BsonFixedLayout
+    {
+        std::vector<std::uint8_t> bytes;
+        std::array<std::uint32_t, N> offsets{};
+        std::array<std::uint32_t, N> widths{};
+    };
+
+    /**
+     * @return Pre-encoded document of a fixed-layout type, built on first use
+     */
+    template <typename T>
+    const auto& bsonFixedLayout()
+    {
+        static const auto layout = []
+        {
+            constexpr auto members = T::bsonMembers();
+            BsonFixedLayout<std::tuple_size_v<decltype(members)>> result;
+            result.bytes.resize(4);
+            std::size_t i = 0;
+            std::apply([&](const auto&... member)
+            {
+                const auto appendSlot = [&](const char* key, bsoncxx::v_noabi::type type, std::size_t width)
+                {
+                    result.bytes.push_back(static_cast<std::uint8_t>(type));
+                    result.bytes.insert(result.bytes.end(), key, key + std::strlen(key) + 1);
+                    result.offsets[i] = static_cast<std::uint32_t>(result.bytes.size());
+                    result.widths[i++] = static_cast<std::uint32_t>(width);
+                    result.bytes.resize(result.bytes.size() + width);
+                };
+                (appendSlot(member.key, bsonFixedType<typename std::decay_t<decltype(member)>::type>(), bsonFixedWidth<typename std::decay_t<decltype(member)>::type>()), ...);
+            }, members);
+            result.bytes.push_back(0);
+            const auto size = static_cast<std::int32_t>(result.bytes.size());
+            std::memcpy(result.bytes.data(), &size, sizeof(size));
+            return result;
+        }();
+        return layout;
+    }
+
+    template <typename T>
+    void bsonWriteFixed(std::uint8_t* out, const T& value)
+    {
+        if constexpr (std::is_same_v<T, bool>)
+        {
+            *out = value ? 1 : 0;
+        }
+        else if constexpr (std::is_enum_v<T>)
+        {
+            const auto raw = static_cast<std::int32_t>(value);
+            std::memcpy(out, &raw, sizeof(raw));
+        }
+        else if constexpr (std::is_same_v<T, std::chrono::system_clock::time_point>)
+        {
+            const std::int64_t millis = std::chrono::duration_cast<std::chrono::milliseconds>(value.time_since_epoch()).count();
+            std::memcpy(out, &millis, sizeof(millis));
+        }
+        else if constexpr (std::is_same_v<T, bsoncxx::v_noabi::oid>)
+        {
+            std::memcpy(out, value.bytes(), bsoncxx::v_noabi::oid::size());
+        }
+        else
+        {
+            std::memcpy(out, &value, sizeof(value));
+        }
+    }
+
+    template <typename T>
+    void bsonReadFixed(const std::uint8_t* data, T& value)
+    {
+        if constexpr (std::is_same_v<T, bool>)
+        {
+            value = *data != 0;
+        }
+        else if constexpr (std::is_enum_v<T>)
+        {
+            std::int32_t raw;
+            std::memcpy(&raw, data, sizeof(raw));
+            value = static_cast<T>(raw);
+        }
+        else if constexpr (std::is_same_v<T, std::chrono::system_clock::time_point>)
+        {
+            std::int64_t millis;
+            std::memcpy(&millis, data, sizeof(millis));
+            value = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::milliseconds(millis)));
+        }
+        else if constexpr (std::is_same_v<T, bsoncxx::v_noabi::oid>)
+        {
+            value = bsoncxx::v_noabi::oid(reinterpret_cast<const char*>(data), bsoncxx::v_noabi::oid::size());
+        }
+        else
+        {
+            std::memcpy(&value, data, sizeof(value));
+        }
+    }
+
+    inline void bsonDeleteBytes(std::uint8_t* bytes)
+    {
+        delete[] bytes;
+    }
+
+    /**
+     * @brief Encode a fixed-layout type by copying its pre-encoded document and patching the values in place
+     * @tparam T Type defined with BSON_DEFINE_TYPE for which bsonIsFixedLayout is true
+     * @param obj Object to encode
+     * @return BSON document, identical to the one built member by member
+     */
+    template <typename T>
+    bsoncxx::v_noabi::document::value bsonFixedLayoutEncode(const T& obj)
+    {
+        const auto& layout = bsonFixedLayout<T>();
+        auto* bytes = new std::uint8_t[layout.bytes.size()];
+        std::memcpy(bytes, layout.bytes.data(), layout.bytes.size());
+        std::size_t i = 0;
+        std::apply([&](const auto&... member)
+        {
+            (bsonWriteFixed(bytes + layout.offsets[i++], obj.*(member.pointer)), ...);
+        }, T::bsonMembers());
+        return bsoncxx::v_noabi::document::value(bytes, layout.bytes.size(), bsonDeleteBytes);
+    }
+
+    /**
+     * @brief Decode a fixed-layout type by reading its values at their pre-computed offsets, if everything but
+     * the values matches the pre-encoded document
+     * @tparam T Type defined with BSON_DEFINE_TYPE
+     * @param doc BSON document to decode
+     * @param out Object to decode into
+     * @return Whether the document was decoded, false if the type or the document doesn't have the fixed layout
+     */
+    template <typename T>
+    bool bsonFixedLayoutDecode(const bsoncxx::v_noabi::document::view& doc, T& out)
+    {
+        if constexpr (bsonIsFixedLayout<T>())
+        {
+            const auto& layout = bsonFixedLayout<T>();
+            if (doc.length() != layout.bytes.size())
+            {
+                return false;
+            }
+
+            const auto* data = doc.data();
+            std::size_t pos = 0;
+            for (std::size_t i = 0; i < layout.offsets.size(); ++i)
+            {
+                if (std::memcmp(data + pos, layout.bytes.data() + pos, layout.offsets[i] - pos) != 0)
+                {
+                    return false;
+                }
+                pos = layout.offsets[i] + layout.widths[i];
+            }
+            if (data[pos] != 0)
+            {
+                return false;
+            }
+
+            std::size_t i = 0;
+            std::apply([&](const auto&... member)
+            {
+                (bsonReadFixed(data + layout.offsets[i++], out.*(member.pointer)), ...);
+            }, T::bsonMembers());
+            return true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+#define BSON_MEMBER_POINTER(class_name, x) , bsonMember(#x, &class_name::x)
+#define RECURSE_MEMBER_POINTERS() BSON_MEMBER_POINTERS_1
+
+#define BSON_MEMBER_POINTERS_1(class_name, x, ...) \
+BSON_MEMBER_POINTER(class_name, x) \
+__VA_OPT__(OBSTRUCT(RECURSE_MEMBER_POINTERS)()(class_name, __VA_ARGS__))
+
+#define BSON_DEFINE_MEMBERS(class_name, ...) \
+static constexpr auto bsonMembers() { \
+return makeBsonMembers(BsonMembersBegin{} EVAL(BSON_MEMBER_POINTERS_1(class_name, __VA_ARGS__))); \
+}
+
+#pragma endregion
+
+#pragma region deserialize methods
+
+// Key under which the alternative of a std::variant member is stored, written as the first key of its sub-document
+#ifndef BSON_VARIANT_DISCRIMINATOR
+#define BSON_VARIANT_DISCRIMINATOR "_t"
+#endif
+
+    /**
+     * @brief Construct an empty container, using the memory resource if the container is pmr-aware
+     * @tparam T Container type
+     * @param resource Memory resource for pmr containers, nullptr for the default resource
+     * @return Empty container
+     */
+    template <typename T>
+    T makeBsonContainer(std::pmr::memory_resource* resource)
+    {
+        if constexpr (is_pmr_aware_v<T>)
+        {
+            return T(typename T::allocator_type(resource != nullptr ? resource : std::pmr::get_default_resource()));
+        }
+        else
+        {
+            return T();
+        }
+    }
+
+    /**
+     * @brief Deserialize a BSON document with the fromBSON of a class, passing the memory resource on
+     * if the class accepts one
+     * @tparam T Class to deserialize to
+     * @param doc BSON document to deserialize from
+     * @param resource Memory resource for pmr members, nullptr for the default resource
+     * @return Deserialized class
+     */
+    template <typename T>
+    T classFromBSON(const bsoncxx::v_noabi::document::view& doc, std::pmr::memory_resource* resource)
+    {
+        if constexpr (has_resource_from_bson_v<T>)
+        {
+            return T::fromBSON(doc, resource);
+        }
+        else
+        {
+            return T::fromBSON(doc);
+        }
+    }
+
+    /**
+     * @brief Deserialize a BSON document to the std::variant alternative named by its discriminator
+     * @tparam Variant std::variant type whose alternatives are defined with BSON_DEFINE_TYPE
+     * @param doc BSON document to deserialize from
+     * @param resource Memory resource for pmr members, nullptr for the default resource
+     * @return Deserialized variant
+     */
+    template <typename Variant, std::size_t... I>
+    Variant variantFromBSON(const bsoncxx::v_noabi::document::view& doc, std::pmr::memory_resource* resource, std::index_sequence<I...>)
+    {
+        using Decoder = Variant (*)(const bsoncxx::v_noabi::document::view&, std::pmr::memory_resource*);
+        static constexpr Decoder decoders[] = {
+            [](const bsoncxx::v_noabi::document::view& d, std::pmr::memory_resource* r) { return Variant(std::in_place_index<I>, classFromBSON<std::variant_alternative_t<I, Variant>>(d, r)); }...
+        };
+        // alternative names are mapped to their index through the same compile-time perfect hash as enum names
+        static constexpr std::array<BsonEnumEntry<std::size_t>, sizeof...(I)> names{{{I, std::variant_alternative_t<I, Variant>::bsonTypeName()}...}};
+        static constexpr auto index = makeBsonEnumIndex(names);
+
+        // the discriminator is written first, so the lookup normally stops at the first element
+        auto it = doc.begin();
+        if (it == doc.end() || it->key() != BSON_VARIANT_DISCRIMINATOR)
+        {
+            it = doc.find(BSON_VARIANT_DISCRIMINATOR);
+        }
+        if (it == doc.end())
+        {
+            throw std::invalid_argument("missing variant discriminator");
+        }
+
+        const auto name = it->get_string().value;
+        const auto* entry = findBsonEnumEntry(names, index, std::string_view(name.data(), name.size()));
+        if (entry == nullptr)
+        {
+            throw std::invalid_argument("unknown variant discriminator");
+        }
+        return decoders[entry->value](doc, resource);
+    }
+
+    /**
+     * @brief Deserialize a BSON element to a C++ type
+     * @tparam T C++ type to deserialize to
+     * @tparam Element BSON element type
+     * @param element BSON element to deserialize
+     * @param resource Memory resource used for std::pmr strings and containers in the decoded value, nullptr for
+     * the default resource
+     * @return Deserialized C++ type
+     */
+    template <typename T, typename Element>
+    T get(const Element& element, std::pmr::memory_resource* resource = nullptr)
+    {
+        if constexpr (std::__is_optional_v<T>)
+        {
+            if (element && element.type() != bsoncxx::v_noabi::type::k_null)
+            {
+                return T(std::in_place, get<typename T::value_type>(element, resource));
+            }
+            return T{};
+        }
+        else if constexpr (std::is_enum_v<T>)
+        {
+            if constexpr (has_bson_enum_table_v<T>)
+            {
+                const auto name = element.get_string().value;
+                return bsonEnumFromName<T>(std::string_view(name.data(), name.size()));
+            }
+            else
+            {
+                return static_cast<T>(element.get_int32().value);
+            }
+        }
+        else if constexpr (std::is_same_v<T, bool>)
+        {
+            return element.get_bool().value;
+        }
+        else if constexpr (std::is_same_v<T, int>)
+        {
+            return element.get_int32().value;
+        }
+        else if constexpr (std::is_same_v<T, int32_t>)
+        {
+            return element.get_int32().value;
+        }
+        else if constexpr (std::is_same_v<T, int64_t>)
+        {
+            return element.get_int64().value;
+        }
+        else if constexpr (std::is_same_v<T, double>)
+        {
+            return element.get_double().value;
+        }
+        else if constexpr (std::is_same_v<T, std::string>)
+        {
+            auto str = element.get_string().value;
+            return std::string(str);
+        }
+        else if constexpr (std::is_same_v<T, std::pmr::string>)
+        {
+            auto str = element.get_string().value;
+            auto pmrStr = makeBsonContainer<T>(resource);
+            pmrStr.assign(str.data(), str.size());
+            return pmrStr;
+        }
+        else if constexpr (std::is_same_v<T, std::chrono::time_point<std::chrono::system_clock>>)
+        {
+            return element.get_date();
+        }
+        else if constexpr (std::is_same_v<T, short>)
+        {
+            return static_cast<unsigned short>(element.get_int32().value);
+        }
+        else if constexpr (std::is_same_v<T, unsigned short>)
+        {
+            return static_cast<unsigned short>(element.get_int32().value);
+        }
+        else if constexpr (is_std_vector_v<T>)
+        {
+            auto vec = makeBsonContainer<T>(resource);
+            vec.reserve(element.get_array().value.length());
+            for (const auto& el : element.get_array().value)
+            {
+                vec.emplace_back(get<typename T::value_type>(el, resource));
+            }
+            return vec;
+        }
+        else if constexpr (std::is_same_v<T, bsoncxx::v_noabi::oid>)
+        {
+            return element.get_oid().value;
+        }
+        else if constexpr (std::is_same_v<T, bsoncxx::v_noabi::document::view>)
+        {
+            // points into the buffer of the source document
+            return element.get_document().view();
+        }
+        else if constexpr (std::is_same_v<T, bsoncxx::v_noabi::document::value>)
+        {
+            return T(element.get_document().view());
+        }
+        else if constexpr (std::is_same_v<T, bsoncxx::v_noabi::array::view>)
+        {
+            // points into the buffer of the source document
+            return element.get_array().value;
+        }
+        else if constexpr (std::is_same_v<T, bsoncxx::v_noabi::array::value>)
+        {
+            return T(element.get_array().value);
+        }
+        else if constexpr (std::is_same_v<T, BsonRawDocument>)
+        {
+            if (element.type() == bsoncxx::v_noabi::type::k_array)
+            {
+                return T(element.get_array().value);
+            }
+            return T(element.get_document().view());
+        }
+        else if constexpr (is_std_variant_v<T>)
+        {
+            return variantFromBSON<T>(element.get_document().view(), resource, std::make_index_sequence<std::variant_size_v<T>>{});
+        }
+        else if constexpr (std::is_class_v<T>)
+        {
+            return classFromBSON<T>(element.get_document().view(), resource);
+        }
+        else
+        {
+            static_assert(always_false_v<T>, "Unsupported type");
+        }
+    }
+
+    /**
+     * @brief Replace a member with a decoded value. Move assignment of a pmr container copies into the allocator
+     * of the target, so the member is destroyed and move constructed instead, keeping the allocator of the value.
+     * @tparam T Type of the member
+     * @param member Member to replace
+     * @param value Decoded value
+     */
+    template <typename T>
+    void replaceMember(T& member, T&& value)
+    {
+        if constexpr (std::is_trivially_copyable_v<T> || !std::is_nothrow_move_constructible_v<T>)
+        {
+            member = std::move(value);
+        }
+        else
+        {
+            member.~T();
+            ::new (static_cast<void*>(std::addressof(member))) T(std::move(value));
+        }
+    }
+
+    /**
+     * @brief Deserialize a member from a BSON document
+     * @tparam T Type of the member
+     * @param member Member to deserialize
+     * @param doc BSON document to deserialize from
+     * @param key Key of the member in the BSON document
+     * @param resource Memory resource used for std::pmr strings and containers, nullptr for the default resource
+     */
+    template <typename T>
+    void deserializeMember(T& member, const bsoncxx::v_noabi::document::view& doc, const std::string& key, std::pmr::memory_resource* resource = nullptr)
+    {
+        auto it = doc.find(key);
+        if (it != doc.end())
+        {
+            if (resource == nullptr)
+            {
+                member = get<T>(*it);
+            }
+            else
+            {
+                replaceMember(member, get<T>(*it, resource));
+            }
+        }
+    }
+
+#define EXPAND(x) x
+#define EVAL(...)  EVAL1024(__VA_ARGS__)
+#define EVAL1024(...) EVAL512(EVAL512(__VA_ARGS__))
+#define EVAL512(...)  EVAL256(EVAL256(__VA_ARGS__))
+#define EVAL256(...)  EVAL128(EVAL128(__VA_ARGS__))
+#define EVAL128(...)  EVAL64(EVAL64(__VA_ARGS__))
+#define EVAL64(...)   EVAL32(EVAL32(__VA_ARGS__))
+#define EVAL32(...)   EVAL16(EVAL16(__VA_ARGS__))
+#define EVAL16(...)   EVAL8(EVAL8(__VA_ARGS__))
+#define EVAL8(...)    EVAL4(EVAL4(__VA_ARGS__))
+#define EVAL4(...)    EVAL2(EVAL2(__VA_ARGS__))
+#define EVAL2(...)    EVAL1(EVAL1(__VA_ARGS__))
+#define EVAL1(...)    __VA_ARGS__
+
+#define EMPTY()
+#define DEFER(id) id EMPTY()
+#define OBSTRUCT(...) __VA_ARGS__ DEFER(EMPTY)()
+
+#define DESERIALIZE_MEMBER_FROM_DOC(member, doc, name) deserializeMember(instance.member, doc, name, resource);
+#define RECURSE_FROM_BSON_INDIRECT() RECURSE_FROM_BSON
+#define RECURSE_FROM_BSON() BSON_FROM_BSON_1
+
+#define BSON_FROM_BSON_1(class_name, x, ...)      \
+DESERIALIZE_MEMBER_FROM_DOC(x, doc, #x)                          \
+__VA_OPT__(OBSTRUCT(RECURSE_FROM_BSON)()(class_name, __VA_ARGS__))
+
+#define BSON_DEFINE_FROM_BSON(class_name, ...)           \
+static class_name fromBSON(const bsoncxx::document::view& doc, std::pmr::memory_resource* resource = nullptr) { \
+BSON_INSTRUMENT_DECODE(class_name, doc) \
+class_name instance{}; \
+if (bsonFixedLayoutDecode(doc, instance)) { \
+return instance; \
+} \
+EVAL(BSON_FROM_BSON_1(class_name, __VA_ARGS__)) \
+return instance;                                        \
+}
+
+#pragma endregion
+
+#pragma region serialize methods
+
+    /**
+     * @brief Serialize a std::variant to a BSON document, tagged with the name of the active alternative
+     * @tparam Ts Alternatives of the variant, defined with BSON_DEFINE_TYPE
+     * @param value Variant to serialize
+     * @return BSON document of the active alternative, with the discriminator as its first key
+     */
+    template <typename... Ts>
+    bsoncxx::v_noabi::document::value variantToBSON(const std::variant<Ts...>& value)
+    {
+        return std::visit([](const auto& alternative)
+        {
+            using Alternative = std::decay_t<decltype(alternative)>;
+            bsoncxx::v_noabi::builder::basic::document doc{};
+            doc.append(bsoncxx::v_noabi::builder::basic::kvp(BSON_VARIANT_DISCRIMINATOR, bsoncxx::v_noabi::stdx::string_view(Alternative::bsonTypeName())));
+            if constexpr (has_append_bson_v<Alternative>)
+            {
+#ifdef CPP_BSON_CONVERT_INSTRUMENTATION
+                // appendBSON is not instrumented, so the alternative is reported here as its toBSON would be
+                BsonInstrumentationScope bsonInstrumentation{Alternative::bsonTypeName(), BsonOperation::Encode};
+#endif
+                Alternative::appendBSON(doc, alternative);
+                auto encoded = doc.extract();
+                BSON_INSTRUMENT_ENCODED_BYTES(encoded)
+                return encoded;
+            }
+            else
+            {
+                doc.append(bsoncxx::v_noabi::builder::concatenate(Alternative::toBSON(alternative).view()));
+                return doc.extract();
+            }
+        }, value);
+    }
+
+    /**
+     * @brief Append a class, variant or enum value to a BSON array
+     * @tparam T Type of the value
+     * @param arr BSON array to append to
+     * @param value Value to append
+     */
+    template <typename T>
+    void appendArrayElement(bsoncxx::v_noabi::builder::basic::array& arr, const T& value)
+    {
+        if constexpr (std::is_same_v<T, std::pmr::string>)
+        {
+            arr.append(bsoncxx::v_noabi::stdx::string_view(value.data(), value.size()));
+        }
+        else if constexpr (std::is_same_v<T, BsonRawDocument>)
+        {
+            if (value.isArray())
+            {
+                arr.append(value.arrayView());
+            }
+            else
+            {
+                arr.append(value.view());
+            }
+        }
+        else if constexpr (std::is_same_v<T, bsoncxx::v_noabi::document::value> || std::is_same_v<T, bsoncxx::v_noabi::array::value>)
+        {
+            arr.append(value.view());
+        }
+        else if constexpr (std::is_same_v<T, bsoncxx::v_noabi::document::view> || std::is_same_v<T, bsoncxx::v_noabi::array::view>)
+        {
+            arr.append(value);
+        }
+        else if constexpr (is_std_variant_v<T>)
+        {
+            arr.append(variantToBSON(value).view());
+        }
+        else if constexpr (std::is_enum_v<T>)
+        {
+            arr.append(bsonEnumValue(value));
+        }
+        else
+        {
+            arr.append(T::toBSON(value).view());
+        }
+    }
+
+    /**
+     * @brief Serialize a primitive member to a BSON document
+     * @tparam T Type of the member
+     * @param doc BSON document to serialize to
+     * @param key Key of the member in the BSON document
+     * @param value Value of the member
+     */
+    template <typename T>
+    std::enable_if_t<is_primitive_v<T>> serializeMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const T& value)
+    {
+        doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, value));
+    }
+
+    /**
+     * @brief Serialize a time_point member to a BSON document
+     * @param doc BSON document to serialize to
+     * @param key Key of the member in the BSON document
+     * @param value Value of the member
+     */
+    inline void serializeMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const std::chrono::system_clock::time_point& value)
+    {
+        doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, bsoncxx::v_noabi::types::b_date{value}));
+    }
+
+    /**
+     * @brief Serialize a std::pmr::string member to a BSON document
+     * @param doc BSON document to serialize to
+     * @param key Key of the member in the BSON document
+     * @param value Value of the member
+     */
+    inline void serializeMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const std::pmr::string& value)
+    {
+        doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, bsoncxx::v_noabi::stdx::string_view(value.data(), value.size())));
+    }
+
+    /**
+     * @brief Serialize an optional member to a BSON document
+     * @tparam T Type of the member
+     * @param doc BSON document to serialize to
+     * @param key Key of the member in the BSON document
+     * @param value Value of the member
+     */
+    template <typename T>
+    std::enable_if_t<is_primitive_v<T>> serializeMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const std::optional<T>& value)
+    {
+        if (value.has_value())
+        {
+            doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, value.value()));
+            return;
+        }
+
+        // if the field is oid, we don't add it at all so that mongodb sets it automatically
+        if (typeid(T) != typeid(bsoncxx::oid))
+        {
+            doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, bsoncxx::v_noabi::types::b_null{}));
+        }
+    }
+
+    /**
+     * @brief Serialize a primitive vector member to a BSON document
+     * @tparam T Type of the member
+     * @param doc BSON document to serialize to
+     * @param key Key of the member in the BSON document
+     * @param value Value of the member
+     */
+    template <typename T, typename Alloc>
+    std::enable_if_t<is_primitive_v<T>> serializeMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const std::vector<T, Alloc>& value)
+    {
+        bsoncxx::v_noabi::builder::basic::array arr;
+        for (const auto& el : value)
+        {
+            arr.append(el);
+        }
+        doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, arr));
+    }
+
+    /**
+     * @brief Serialize a non primitive vector member to a BSON document
+     * @tparam T Type of the member
+     * @param doc BSON document to serialize to
+     * @param key Key of the member in the BSON document
+     * @param value Value of the member
+     */
+    template <typename T, typename Alloc>
+    std::enable_if_t<!is_primitive_v<T>> serializeMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const std::vector<T, Alloc>& value)
+    {
+        bsoncxx::v_noabi::builder::basic::array arr;
+        for (const auto& el : value)
+        {
+            appendArrayElement(arr, el);
+        }
+        doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, arr));
+    }
+
+    /**
+     * @brief Serialize a primitive optional vector member to a BSON document
+     * @tparam T Type of the member
+     * @param doc BSON document to serialize to
+     * @param key Key of the member in the BSON document
+     * @param value Value of the member
+     */
+    template <typename T, typename Alloc>
+    std::enable_if_t<is_primitive_v<T>> serializeMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const std::optional<std::vector<T, Alloc>>& value)
+    {
+        if (value.has_value())
+        {
+            bsoncxx::v_noabi::builder::basic::array arr;
+            for (const auto& el : value.value())
+            {
+                arr.append(el);
+            }
+            doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, arr));
+            return;
+        }
+
+        doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, bsoncxx::v_noabi::types::b_null{}));
+    }
+
+    /**
+     * @brief Serialize a non primitive optional vector member to a BSON document
+     * @tparam T Type of the member
+     * @param doc BSON document to serialize to
+     * @param key Key of the member in the BSON document
+     * @param value Value of the member
+     */
+    template <typename T, typename Alloc>
+    std::enable_if_t<!is_primitive_v<T>> serializeMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const std::optional<std::vector<T, Alloc>>& value)
+    {
+        if (value.has_value())
+        {
+            bsoncxx::v_noabi::builder::basic::array arr;
+            for (const auto& el : value.value())
+            {
+                appendArrayElement(arr, el);
+            }
+            doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, arr));
+            return;
+        }
+        doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, bsoncxx::v_noabi::types::b_null{}));
+    }
+
+    /**
+     * @brief Serialize a class member to a BSON document
+     * @tparam T Type of the member
+     * @param doc BSON document to serialize to
+     * @param key Key of the member in the BSON document
+     * @param value Value of the member
+     */
+    template <typename T>
+    std::enable_if_t<!is_primitive_v<T> && !is_std_vector_v<T> && !std::__is_optional_v<T> && !is_std_variant_v<T> && !std::is_enum_v<T> && !is_bson_raw_v<T>> serializeMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const T& value)
+    {
+        doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, T::toBSON(value).view()));
+    }
+
+    /**
+     * @brief Serialize a raw sub-document or array member to a BSON document by appending its bytes verbatim
+     * @tparam T Type of the member
+     * @param doc BSON document to serialize to
+     * @param key Key of the member in the BSON document
+     * @param value Value of the member
+     */
+    template <typename T>
+    std::enable_if_t<is_bson_raw_v<T>> serializeMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const T& value)
+    {
+        if constexpr (std::is_same_v<T, BsonRawDocument>)
+        {
+            if (value.isArray())
+            {
+                doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, value.arrayView()));
+                return;
+            }
+            doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, value.view()));
+        }
+        else if constexpr (std::is_same_v<T, bsoncxx::v_noabi::document::value> || std::is_same_v<T, bsoncxx::v_noabi::array::value>)
+        {
+            doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, value.view()));
+        }
+        else
+        {
+            doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, value));
+        }
+    }
+
+    /**
+     * @brief Serialize an enum member to a BSON document, as a string if the enum is declared with
+     * BSON_DEFINE_ENUM and as an int32 otherwise
+     * @tparam T Type of the member
+     * @param doc BSON document to serialize to
+     * @param key Key of the member in the BSON document
+     * @param value Value of the member
+     */
+    template <typename T>
+    std::enable_if_t<std::is_enum_v<T>> serializeMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const T& value)
+    {
+        doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, bsonEnumValue(value)));
+    }
+
+    /**
+     * @brief Serialize a std::variant member to a BSON document
+     * @tparam Ts Alternatives of the variant
+     * @param doc BSON document to serialize to
+     * @param key Key of the member in the BSON document
+     * @param value Value of the member
+     */
+    template <typename... Ts>
+    void serializeMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const std::variant<Ts...>& value)
+    {
+        doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, variantToBSON(value).view()));
+    }
+
+    /**
+     * @brief Serialize an optional member to a BSON document
+     * @tparam T Type of the member
+     * @param doc BSON document to serialize to
+     * @param key Key of the member in the BSON document
+     * @param value Value of the member
+     */
+    template <typename T>
+    std::enable_if_t<!is_primitive_v<T>> serializeMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const std::optional<T>& value)
+    {
+        if (value.has_value())
+        {
+            serializeMember(doc, key, value.value());
+            return;
+        }
+        doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, bsoncxx::v_noabi::types::b_null{}));
+    }
+
+
+#define APPEND_MEMBER_TO_DOC(member, doc, name) serializeMember(doc, name, obj.member);
+
+#define RECURSE_TO_BSON_INDIRECT() RECURSE_TO_BSON
+#define RECURSE_TO_BSON() BSON_TO_BSON_1
+
+#define BSON_TO_BSON_1(class_name, x, ...)       \
+APPEND_MEMBER_TO_DOC(x, doc, #x)                \
+__VA_OPT__(OBSTRUCT(RECURSE_TO_BSON)()(class_name, __VA_ARGS__))
+
+#define BSON_DEFINE_TO_BSON(class_name, ...)           \
+static void appendBSON(bsoncxx::v_noabi::builder::basic::document& doc, const class_name& obj) { \
+EVAL(BSON_TO_BSON_1(class_name, __VA_ARGS__)) \
+} \
+static bsoncxx::document::value toBSON(const class_name& obj) { \
+BSON_INSTRUMENT_ENCODE(class_name) \
+if constexpr (bsonIsFixedLayout<class_name>()) { \
+auto value = bsonFixedLayoutEncode(obj); \
+BSON_INSTRUMENT_ENCODED_BYTES(value) \
+return value; \
+} \
+bsoncxx::v_noabi::builder::basic::document doc{}; \
+appendBSON(doc, obj); \
+auto value = doc.extract(); \
+BSON_INSTRUMENT_ENCODED_BYTES(value) \
+return value; \
+}
+
+#define BSON_DEFINE_TYPE_NAME(class_name)           \
+static constexpr const char* bsonTypeName() { return #class_name; }
+
+#define BSON_DEFINE_KEY_IDENTITY()           \
+static constexpr std::string_view bsonKey(std::string_view member) { return member; }
+
+#define BSON_DEFINE_TYPE(class_name, ...)           \
+BSON_DEFINE_TYPE_NAME(class_name) \
+BSON_DEFINE_KEY_IDENTITY() \
+BSON_DEFINE_MEMBERS(class_name, __VA_ARGS__) \
+BSON_DEFINE_FROM_BSON(class_name, __VA_ARGS__) \
+BSON_DEFINE_TO_BSON(class_name, __VA_ARGS__)
+
+#pragma endregion
+
+#pragma region compact profile
+
+    /**
+     * @brief Serialize a member for the compact profile: like serializeMember, but empty optionals are left out
+     * instead of being written as null
+     * @tparam T Type of the member
      * @param doc BSON document to serialize to
      * @param key Key of the member in the BSON document
      * @param value Value of the member
      */
     template <typename T>
-    std::enable_if_t<!is_primitive_v<T>> serializeMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const std::optional<T>& value)
+    void serializeCompactMember(bsoncxx::v_noabi::builder::basic::document& doc, const std::string& key, const T& value)
+    {
+        if constexpr (std::__is_optional_v<T>)
+        {
+            if (!value.has_value())
+            {
+                return;
+            }
+        }
+        serializeMember(doc, key, value);
+    }
+
+    template <typename... Keys>
+    constexpr std::array<std::string_view, sizeof...(Keys)> makeBsonKeys(BsonMembersBegin, Keys... keys)
+    {
+        return {std::string_view(keys)...};
+    }
+
+#define BSON_CAT(a, b) BSON_CAT_I(a, b)
+#define BSON_CAT_I(a, b) a ## b
+#define BSON_STRINGIFY(x) BSON_STRINGIFY_I(x)
+#define BSON_STRINGIFY_I(x) #x
+
+// Expands to 1 if x is parenthesized, 0 otherwise
+#define BSON_IS_PAREN(x) BSON_IS_PAREN_CHECK(BSON_IS_PAREN_PROBE x)
+#define BSON_IS_PAREN_PROBE(...) ~, 1,
+#define BSON_IS_PAREN_CHECK(...) BSON_IS_PAREN_CHECK_N(__VA_ARGS__, 0, ~)
+#define BSON_IS_PAREN_CHECK_N(x, n, ...) n
+
+// A compact member is either `member`, stored under its own name, or `(member, "alias")`
+#define BSON_ALIAS_MEMBER(member, alias) member
+#define BSON_ALIAS_KEY(member, alias) alias
+#define BSON_MEMBER_NAME(x) BSON_CAT(BSON_MEMBER_NAME_, BSON_IS_PAREN(x))(x)
+#define BSON_MEMBER_NAME_0(x) x
+#define BSON_MEMBER_NAME_1(x) BSON_ALIAS_MEMBER x
+#define BSON_MEMBER_KEY(x) BSON_CAT(BSON_MEMBER_KEY_, BSON_IS_PAREN(x))(x)
+#define BSON_MEMBER_KEY_0(x) #x
+#define BSON_MEMBER_KEY_1(x) BSON_ALIAS_KEY x
+
+#define RECURSE_COMPACT_FROM_BSON() BSON_COMPACT_FROM_BSON_1
+#define BSON_COMPACT_FROM_BSON_1(class_name, x, ...)      \
+DESERIALIZE_MEMBER_FROM_DOC(BSON_MEMBER_NAME(x), doc, BSON_MEMBER_KEY(x))                          \
+__VA_OPT__(OBSTRUCT(RECURSE_COMPACT_FROM_BSON)()(class_name, __VA_ARGS__))
+
+#define RECURSE_COMPACT_TO_BSON() BSON_COMPACT_TO_BSON_1
+#define BSON_COMPACT_TO_BSON_1(class_name, x, ...)       \
+serializeCompactMember(doc, BSON_MEMBER_KEY(x), obj.BSON_MEMBER_NAME(x));                \
+__VA_OPT__(OBSTRUCT(RECURSE_COMPACT_TO_BSON)()(class_name, __VA_ARGS__))
+
+#define RECURSE_COMPACT_KEYS() BSON_COMPACT_KEYS_1
+#define BSON_COMPACT_KEYS_1(class_name, x, ...)       \
+, BSON_MEMBER_KEY(x)                \
+__VA_OPT__(OBSTRUCT(RECURSE_COMPACT_KEYS)()(class_name, __VA_ARGS__))
+
+#define RECURSE_COMPACT_KEY() BSON_COMPACT_KEY_1
+#define BSON_COMPACT_KEY_1(class_name, x, ...)       \
+if (member == BSON_STRINGIFY(BSON_MEMBER_NAME(x))) return BSON_MEMBER_KEY(x);                \
+__VA_OPT__(OBSTRUCT(RECURSE_COMPACT_KEY)()(class_name, __VA_ARGS__))
+
+/**
+ * Like BSON_DEFINE_TYPE, but with the compact storage profile: members declared as `(member, "alias")`
+ * are stored under their alias, and empty optionals are omitted instead of being written as null.
+ * bsonKey("member") returns the key a member is stored under. Two members stored under the same key, through
+ * aliases or an alias equal to the name of another member, fail to compile.
+ */
+#define BSON_DEFINE_COMPACT_TYPE(class_name, ...)           \
+static_assert(!bsonHasDuplicateKeys(makeBsonKeys(BsonMembersBegin{} EVAL(BSON_COMPACT_KEYS_1(class_name, __VA_ARGS__)))), \
+"two members of " #class_name " are stored under the same key"); \
+BSON_DEFINE_TYPE_NAME(class_name) \
+static constexpr std::string_view bsonKey(std::string_view member) { \
+EVAL(BSON_COMPACT_KEY_1(class_name, __VA_ARGS__)) \
+return member; \
+} \
+static class_name fromBSON(const bsoncxx::document::view& doc, std::pmr::memory_resource* resource = nullptr) { \
+BSON_INSTRUMENT_DECODE(class_name, doc) \
+class_name instance{}; \
+EVAL(BSON_COMPACT_FROM_BSON_1(class_name, __VA_ARGS__)) \
+return instance; \
+} \
+static void appendBSON(bsoncxx::v_noabi::builder::basic::document& doc, const class_name& obj) { \
+EVAL(BSON_COMPACT_TO_BSON_1(class_name, __VA_ARGS__)) \
+} \
+static bsoncxx::document::value toBSON(const class_name& obj) { \
+BSON_INSTRUMENT_ENCODE(class_name) \
+bsoncxx::v_noabi::builder::basic::document doc{}; \
+appendBSON(doc, obj); \
+auto value = doc.extract(); \
+BSON_INSTRUMENT_ENCODED_BYTES(value) \
+return value; \
+}
+
+#pragma endregion
+
+#pragma region literals
+
+    /**
+     * @brief IEEE 754 bit pattern of a double, computed in a constant expression. -0.0 is encoded as 0.0, since
+     * -0.0 == 0.0 and C++17 offers no portable way to read the sign of a zero in a constant expression.
+     */
+    constexpr std::uint64_t bsonDoubleBits(double value)
+    {
+        if (value != value)
+        {
+            return 0x7ff8000000000000ULL;
+        }
+        std::uint64_t sign = 0;
+        if (value < 0)
+        {
+            sign = 1ULL << 63;
+            value = -value;
+        }
+        if (value == 0)
+        {
+            return sign;
+        }
+        if (value > 1.7976931348623157e308)
+        {
+            return sign | 0x7ff0000000000000ULL;
+        }
+
+        int exponent = 0;
+        while (value >= 2)
+        {
+            value /= 2;
+            ++exponent;
+        }
+        while (value < 1)
+        {
+            value *= 2;
+            --exponent;
+        }
+
+        if (exponent < -1022)
+        {
+            // subnormal: the value is a whole multiple of 2^-1074
+            for (int i = exponent + 1074; i > 0; --i)
+            {
+                value *= 2;
+            }
+            return sign | static_cast<std::uint64_t>(value);
+        }
+
+        const auto fraction = static_cast<std::uint64_t>((value - 1) * 4503599627370496.0); // 2^52
+        return sign | (static_cast<std::uint64_t>(exponent + 1023) << 52) | fraction;
+    }
+
+    /**
+     * @brief Fixed-width little-endian value of a BSON literal
+     */
+    template <bsoncxx::v_noabi::type Type, std::size_t Size>
+    struct BsonLiteralScalar
+    {
+        static constexpr auto type = Type;
+        static constexpr std::size_t size = Size;
+
+        std::uint64_t bits;
+
+        constexpr void write(std::uint8_t* out) const
+        {
+            for (std::size_t i = 0; i < Size; ++i)
+            {
+                out[i] = static_cast<std::uint8_t>(bits >> (8 * i));
+            }
+        }
+    };
+
+    /**
+     * @brief String value of a BSON literal, with the length of the string literal it was made from
+     */
+    template <std::size_t N>
+    struct BsonLiteralString
+    {
+        static constexpr auto type = bsoncxx::v_noabi::type::k_string;
+        static constexpr std::size_t size = 4 + N;
+
+        const char* value;
+
+        constexpr void write(std::uint8_t* out) const
+        {
+            BsonLiteralScalar<bsoncxx::v_noabi::type::k_int32, 4>{N}.write(out);
+            for (std::size_t i = 0; i + 1 < N; ++i)
+            {
+                out[4 + i] = static_cast<std::uint8_t>(value[i]);
+            }
+            out[4 + N - 1] = 0;
+        }
+    };
+
+    /**
+     * @brief BSON document or array whose bytes are computed at compile time
+     * @tparam N Size of the document in bytes
+     * @tparam IsArray Whether the bytes are a BSON array rather than a document
+     */
+    template <std::size_t N, bool IsArray = false>
+    struct BsonLiteral
+    {
+        static constexpr auto type = IsArray ? bsoncxx::v_noabi::type::k_array : bsoncxx::v_noabi::type::k_document;
+        static constexpr std::size_t size = N;
+
+        std::array<std::uint8_t, N> bytes{};
+
+        constexpr void write(std::uint8_t* out) const
+        {
+            for (std::size_t i = 0; i < N; ++i)
+            {
+                out[i] = bytes[i];
+            }
+        }
+
+        /**
+         * @return View of the literal, valid as long as the literal
+         */
+        bsoncxx::v_noabi::document::view view() const
+        {
+            return bsoncxx::v_noabi::document::view(bytes.data(), N);
+        }
+
+        /**
+         * @return View of an array literal, valid as long as the literal
+         */
+        bsoncxx::v_noabi::array::view arrayView() const
+        {
+            static_assert(IsArray, "not an array literal");
+            return bsoncxx::v_noabi::array::view(bytes.data(), N);
+        }
+    };
+
+    // Literal values, mapped to the same BSON types as serializeMember
+    constexpr auto bsonLiteralValue(bool value)
+    {
+        return BsonLiteralScalar<bsoncxx::v_noabi::type::k_bool, 1>{value ? 1u : 0u};
+    }
+
+    constexpr auto bsonLiteralValue(std::int32_t value)
+    {
+        return BsonLiteralScalar<bsoncxx::v_noabi::type::k_int32, 4>{static_cast<std::uint32_t>(value)};
+    }
+
+    constexpr auto bsonLiteralValue(std::int64_t value)
+    {
+        return BsonLiteralScalar<bsoncxx::v_noabi::type::k_int64, 8>{static_cast<std::uint64_t>(value)};
+    }
+
+    constexpr auto bsonLiteralValue(double value)
+    {
+        return BsonLiteralScalar<bsoncxx::v_noabi::type::k_double, 8>{bsonDoubleBits(value)};
+    }
+
+    constexpr auto bsonLiteralValue(std::nullopt_t)
+    {
+        return BsonLiteralScalar<bsoncxx::v_noabi::type::k_null, 0>{0};
+    }
+
+    template <std::size_t N>
+    constexpr auto bsonLiteralValue(const char (&value)[N])
+    {
+        return BsonLiteralString<N>{value};
+    }
+
+    template <std::size_t N, bool IsArray>
+    constexpr auto bsonLiteralValue(const BsonLiteral<N, IsArray>& value)
+    {
+        return value;
+    }
+
+    template <typename T>
+    constexpr auto bsonLiteralValue(const T& value) -> std::enable_if_t<std::is_enum_v<T>, BsonLiteralScalar<bsoncxx::v_noabi::type::k_int32, 4>>
+    {
+        static_assert(!has_bson_enum_table_v<T>, "enums stored by name cannot be used in literals");
+        return bsonLiteralValue(static_cast<std::int32_t>(value));
+    }
+
+    template <typename T>
+    constexpr auto bsonLiteralValue(const T& value) -> decltype(T::toBSONLiteral(value))
+    {
+        return T::toBSONLiteral(value);
+    }
+
+    /**
+     * @brief Key and value of a BSON literal
+     */
+    template <std::size_t K, typename Value>
+    struct BsonLiteralField
+    {
+        static constexpr std::size_t size = 1 + K + Value::size;
+
+        const char* key;
+        Value value;
+
+        constexpr void write(std::uint8_t* out) const
+        {
+            out[0] = static_cast<std::uint8_t>(Value::type);
+            for (std::size_t i = 0; i + 1 < K; ++i)
+            {
+                out[1 + i] = static_cast<std::uint8_t>(key[i]);
+            }
+            out[K] = 0;
+            value.write(out + 1 + K);
+        }
+    };
+
+    struct BsonLiteralBegin
+    {
+    };
+
+    /**
+     * @brief Key and value of a document literal
+     * @param key Key, a string literal
+     * @param value Value: bool, int32, int64, double, std::nullopt, a string literal, an enum stored as int32,
+     * a nested literal or a type defined with BSON_DEFINE_LITERAL
+     */
+    template <std::size_t K, typename T>
+    constexpr auto bsonField(const char (&key)[K], const T& value)
+    {
+        using Value = decltype(bsonLiteralValue(value));
+        return BsonLiteralField<K, Value>{key, bsonLiteralValue(value)};
+    }
+
+    /**
+     * @brief Build a BSON document at compile time
+     * @param fields Fields of the document, made with bsonField
+     * @return Literal holding the bytes of the document
+     */
+    template <typename... Fields>
+    constexpr auto bsonLiteral(const Fields&... fields)
+    {
+        constexpr std::size_t size = 4 + (std::size_t{0} + ... + Fields::size) + 1;
+        BsonLiteral<size> literal{};
+        BsonLiteralScalar<bsoncxx::v_noabi::type::k_int32, 4>{size}.write(literal.bytes.data());
+        std::size_t pos = 4;
+        ((fields.write(literal.bytes.data() + pos), pos += Fields::size), ...);
+        return literal;
+    }
+
+    template <typename... Fields>
+    constexpr auto bsonLiteral(BsonLiteralBegin, const Fields&... fields)
+    {
+        return bsonLiteral(fields...);
+    }
+
+    constexpr std::size_t bsonIndexKeyLength(std::size_t index)
+    {
+        std::size_t digits = 1;
+        for (; index >= 10; index /= 10)
+        {
+            ++digits;
+        }
+        return digits;
+    }
+
+    template <typename... Values, std::size_t... I>
+    constexpr auto bsonArrayLiteral(std::index_sequence<I...>, const Values&... values)
+    {
+        constexpr std::size_t size = 4 + (std::size_t{0} + ... + (2 + bsonIndexKeyLength(I) + Values::size)) + 1;
+        BsonLiteral<size, true> literal{};
+        auto* out = literal.bytes.data();
+        BsonLiteralScalar<bsoncxx::v_noabi::type::k_int32, 4>{size}.write(out);
+        std::size_t pos = 4;
+        const auto writeElement = [&](std::size_t index, const auto& value)
+        {
+            out[pos] = static_cast<std::uint8_t>(std::decay_t<decltype(value)>::type);
+            const auto length = bsonIndexKeyLength(index);
+            for (std::size_t i = length; i > 0; --i, index /= 10)
+            {
+                out[pos + i] = static_cast<std::uint8_t>('0' + index % 10);
+            }
+            out[pos + length + 1] = 0;
+            value.write(out + pos + length + 2);
+            pos += 2 + length + std::decay_t<decltype(value)>::size;
+        };
+        (writeElement(I, values), ...);
+        return literal;
+    }
+
+    /**
+     * @brief Build a BSON array at compile time
+     * @param values Elements of the array, of any type accepted by bsonField
+     * @return Literal holding the bytes of the array
+     */
+    template <typename... Ts>
+    constexpr auto bsonArray(const Ts&... values)
+    {
+        return bsonArrayLiteral(std::index_sequence_for<Ts...>{}, bsonLiteralValue(values)...);
+    }
+
+#define BSON_LITERAL_FIELD(x) , bsonField(#x, obj.x)
+#define RECURSE_LITERAL_FIELDS() BSON_LITERAL_FIELDS_1
+
+#define BSON_LITERAL_FIELDS_1(class_name, x, ...) \
+BSON_LITERAL_FIELD(x) \
+__VA_OPT__(OBSTRUCT(RECURSE_LITERAL_FIELDS)()(class_name, __VA_ARGS__))
+
+/**
+ * Defines a constexpr toBSONLiteral(obj) that encodes an instance at compile time, for types whose members
+ * are all accepted by bsonField. Instances can then be used as values of other literals.
+ */
+#define BSON_DEFINE_LITERAL(class_name, ...) \
+static constexpr auto toBSONLiteral(const class_name& obj) { \
+return bsonLiteral(BsonLiteralBegin{} EVAL(BSON_LITERAL_FIELDS_1(class_name, __VA_ARGS__))); \
+}
+
+#pragma endregion
+
+#pragma region validation
+
+    /**
+     * @brief Reason an untrusted BSON buffer was rejected
+     */
+    enum class BsonValidationError
+    {
+        None,
+        Truncated,
+        InvalidLength,
+        MissingTerminator,
+        InvalidType,
+        InvalidUtf8,
+        InvalidBool,
+        TooDeep,
+        TypeMismatch
+    };
+
+    /**
+     * @brief Outcome of validating a BSON buffer, converts to true when the buffer is valid
+     */
+    struct BsonValidationResult
+    {
+        BsonValidationError error = BsonValidationError::None;
+        std::size_t offset = 0;
+
+        explicit operator bool() const
+        {
+            return error == BsonValidationError::None;
+        }
+    };
+
+    /// Nesting limit of validateBSON, matching the one of the server
+    inline constexpr int bsonMaxValidationDepth = 100;
+
+    /**
+     * @brief Read a little-endian int32 from a BSON buffer
+     * @param data Pointer to the first byte of the value
+     * @return Decoded value
+     */
+    inline std::int32_t bsonReadInt32(const std::uint8_t* data)
+    {
+        std::int32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    /**
+     * @brief Validate the multi-byte UTF-8 sequence starting at data[0]
+     * @param data Start of the sequence
+     * @param length Number of bytes available
+     * @return Length of the sequence, or 0 if it is invalid
+     */
+    inline std::size_t validateUtf8Sequence(const std::uint8_t* data, std::size_t length)
+    {
+        const auto lead = data[0];
+        std::size_t size;
+        std::uint8_t min = 0x80;
+        std::uint8_t max = 0xBF;
+        if (lead >= 0xC2 && lead <= 0xDF)
+        {
+            size = 2;
+        }
+        else if (lead >= 0xE0 && lead <= 0xEF)
+        {
+            size = 3;
+            min = lead == 0xE0 ? 0xA0 : 0x80; // overlong
+            max = lead == 0xED ? 0x9F : 0xBF; // surrogates
+        }
+        else if (lead >= 0xF0 && lead <= 0xF4)
+        {
+            size = 4;
+            min = lead == 0xF0 ? 0x90 : 0x80; // overlong
+            max = lead == 0xF4 ? 0x8F : 0xBF; // above U+10FFFF
+        }
+        else
+        {
+            return 0;
+        }
+
+        if (size > length || data[1] < min || data[1] > max)
+        {
+            return 0;
+        }
+        for (std::size_t i = 2; i < size; ++i)
+        {
+            if (data[i] < 0x80 || data[i] > 0xBF)
+            {
+                return 0;
+            }
+        }
+        return size;
+    }
+
+    /**
+     * @brief Check that a byte range is well-formed UTF-8. ASCII runs are skipped a vector at a time
+     * (AVX2 or SSE2 when the target has them, 8-byte words otherwise); only non-ASCII sequences are
+     * decoded byte by byte.
+     * @param data Start of the range
+     * @param length Number of bytes in the range
+     * @return True if the range is valid UTF-8
+     */
+    inline bool isValidUtf8(const std::uint8_t* data, std::size_t length)
+    {
+        std::size_t i = 0;
+        while (i < length)
+        {
+#if defined(__AVX2__)
+            while (i + 32 <= length && _mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i))) == 0)
+            {
+                i += 32;
+            }
+#endif
+#if defined(__SSE2__)
+            while (i + 16 <= length && _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i))) == 0)
+            {
+                i += 16;
+            }
+#endif
+            while (i + 8 <= length)
+            {
+                std::uint64_t word;
+                std::memcpy(&word, data + i, sizeof(word));
+                if (word & 0x8080808080808080ULL)
+                {
+                    break;
+                }
+                i += 8;
+            }
+
+            while (i < length && data[i] < 0x80)
+            {
+                ++i;
+            }
+            if (i == length)
+            {
+                break;
+            }
+
+            const auto size = validateUtf8Sequence(data + i, length - i);
+            if (size == 0)
+            {
+                return false;
+            }
+            i += size;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Validate a NUL-terminated key or regex component
+     * @return Offset just past the terminator, or 0 if the string is invalid
+     */
+    inline std::size_t validateBSONCString(const std::uint8_t* data, std::size_t pos, std::size_t end, BsonValidationResult& result)
+    {
+        // keys are short and almost always ASCII: find the terminator and check them in the same byte loop,
+        // falling back to memchr and a full UTF-8 check at the first non-ASCII byte
+        for (auto i = pos; i < end && data[i] < 0x80; ++i)
+        {
+            if (data[i] == 0)
+            {
+                return i + 1;
+            }
+        }
+
+        const auto* terminator = static_cast<const std::uint8_t*>(std::memchr(data + pos, 0, end - pos));
+        if (!terminator)
+        {
+            result = {BsonValidationError::MissingTerminator, pos};
+            return 0;
+        }
+        const auto size = static_cast<std::size_t>(terminator - (data + pos));
+        if (!isValidUtf8(data + pos, size))
+        {
+            result = {BsonValidationError::InvalidUtf8, pos};
+            return 0;
+        }
+        return pos + size + 1;
+    }
+
+    /**
+     * @brief Validate a length-prefixed string value
+     * @return Offset just past the value, or 0 if the string is invalid
+     */
+    inline std::size_t validateBSONString(const std::uint8_t* data, std::size_t pos, std::size_t end, BsonValidationResult& result)
+    {
+        if (end - pos < 4)
+        {
+            result = {BsonValidationError::Truncated, pos};
+            return 0;
+        }
+        const auto size = bsonReadInt32(data + pos);
+        if (size < 1 || static_cast<std::size_t>(size) > end - pos - 4)
+        {
+            result = {BsonValidationError::InvalidLength, pos};
+            return 0;
+        }
+        if (data[pos + 4 + size - 1] != 0)
+        {
+            result = {BsonValidationError::MissingTerminator, pos + 4 + size - 1};
+            return 0;
+        }
+        if (!isValidUtf8(data + pos + 4, size - 1))
+        {
+            result = {BsonValidationError::InvalidUtf8, pos + 4};
+            return 0;
+        }
+        return pos + 4 + size;
+    }
+
+    /// Element callback of validateBSONDocument that only validates
+    struct BsonNoElementCallback
+    {
+        constexpr bool operator()(std::size_t, std::size_t, std::size_t) const
+        {
+            return true;
+        }
+    };
+
+    /**
+     * @brief Validate the document starting at data[pos] and ending no later than end
+     * @param onElement Called with the offsets of the type byte, of the value and just past the value of every
+     * top-level element, once the element, including any sub-document, is validated. Returning false stops the
+     * walk; the callback then sets result itself.
+     * @return Offset just past the document, or 0 if it is invalid
+     */
+    template <typename OnElement = BsonNoElementCallback>
+    std::size_t validateBSONDocument(const std::uint8_t* data, std::size_t pos, std::size_t end, int depth, BsonValidationResult& result, OnElement&& onElement = OnElement{})
+    {
+        if (depth > bsonMaxValidationDepth)
+        {
+            result = {BsonValidationError::TooDeep, pos};
+            return 0;
+        }
+        if (end - pos < 5)
+        {
+            result = {BsonValidationError::Truncated, pos};
+            return 0;
+        }
+        const auto size = bsonReadInt32(data + pos);
+        if (size < 5 || static_cast<std::size_t>(size) > end - pos)
+        {
+            result = {BsonValidationError::InvalidLength, pos};
+            return 0;
+        }
+
+        const std::size_t documentEnd = pos + size - 1;
+        if (data[documentEnd] != 0)
+        {
+            result = {BsonValidationError::MissingTerminator, documentEnd};
+            return 0;
+        }
+
+        pos += 4;
+        while (pos < documentEnd)
+        {
+            const auto elementOffset = pos;
+            const auto type = static_cast<bsoncxx::v_noabi::type>(data[pos++]);
+            pos = validateBSONCString(data, pos, documentEnd, result);
+            if (pos == 0)
+            {
+                return 0;
+            }
+            const auto valueOffset = pos;
+
+            std::size_t fixedSize = 0;
+            switch (type)
+            {
+            case bsoncxx::v_noabi::type::k_double:
+            case bsoncxx::v_noabi::type::k_date:
+            case bsoncxx::v_noabi::type::k_timestamp:
+            case bsoncxx::v_noabi::type::k_int64:
+                fixedSize = 8;
+                break;
+            case bsoncxx::v_noabi::type::k_int32:
+                fixedSize = 4;
+                break;
+            case bsoncxx::v_noabi::type::k_oid:
+                fixedSize = 12;
+                break;
+            case bsoncxx::v_noabi::type::k_decimal128:
+                fixedSize = 16;
+                break;
+            case bsoncxx::v_noabi::type::k_undefined:
+            case bsoncxx::v_noabi::type::k_null:
+            case bsoncxx::v_noabi::type::k_minkey:
+            case bsoncxx::v_noabi::type::k_maxkey:
+                break;
+            case bsoncxx::v_noabi::type::k_bool:
+                if (pos < documentEnd && data[pos] > 1)
+                {
+                    result = {BsonValidationError::InvalidBool, pos};
+                    return 0;
+                }
+                fixedSize = 1;
+                break;
+            case bsoncxx::v_noabi::type::k_string:
+            case bsoncxx::v_noabi::type::k_code:
+            case bsoncxx::v_noabi::type::k_symbol:
+                pos = validateBSONString(data, pos, documentEnd, result);
+                break;
+            case bsoncxx::v_noabi::type::k_document:
+            case bsoncxx::v_noabi::type::k_array:
+                pos = validateBSONDocument(data, pos, documentEnd, depth + 1, result);
+                break;
+            case bsoncxx::v_noabi::type::k_binary:
+                if (documentEnd - pos < 5)
+                {
+                    result = {BsonValidationError::Truncated, pos};
+                    return 0;
+                }
+                if (bsonReadInt32(data + pos) < 0)
+                {
+                    result = {BsonValidationError::InvalidLength, pos};
+                    return 0;
+                }
+                fixedSize = 5 + static_cast<std::size_t>(bsonReadInt32(data + pos));
+                break;
+            case bsoncxx::v_noabi::type::k_regex:
+                pos = validateBSONCString(data, pos, documentEnd, result);
+                pos = pos ? validateBSONCString(data, pos, documentEnd, result) : 0;
+                break;
+            case bsoncxx::v_noabi::type::k_dbpointer:
+                pos = validateBSONString(data, pos, documentEnd, result);
+                fixedSize = 12;
+                break;
+            case bsoncxx::v_noabi::type::k_codewscope:
+            {
+                if (documentEnd - pos < 4)
+                {
+                    result = {BsonValidationError::Truncated, pos};
+                    return 0;
+                }
+                const auto scopeStart = pos;
+                const auto scopeSize = bsonReadInt32(data + pos);
+                pos = validateBSONString(data, pos + 4, documentEnd, result);
+                pos = pos ? validateBSONDocument(data, pos, documentEnd, depth + 1, result) : 0;
+                if (pos && pos - scopeStart != static_cast<std::size_t>(scopeSize))
+                {
+                    result = {BsonValidationError::InvalidLength, scopeStart};
+                    return 0;
+                }
+                break;
+            }
+            default:
+                result = {BsonValidationError::InvalidType, elementOffset};
+                return 0;
+            }
+
+            if (pos == 0)
+            {
+                return 0;
+            }
+            if (fixedSize > documentEnd - pos)
+            {
+                result = {BsonValidationError::Truncated, pos};
+                return 0;
+            }
+            pos += fixedSize;
+
+            if (!onElement(elementOffset, valueOffset, pos))
+            {
+                return 0;
+            }
+        }
+
+        return documentEnd + 1;
+    }
+
+    /**
+     * @brief Validate an untrusted BSON buffer without throwing. Length prefixes, terminators, element
+     * types, booleans and the UTF-8 of every key and string are checked in a single pass.
+     * @param data Start of the buffer
+     * @param length Size of the buffer, which must cover the declared size of the document
+     * @return Result describing the first problem found, if any
+     */
+    inline BsonValidationResult validateBSON(const std::uint8_t* data, std::size_t length)
+    {
+        BsonValidationResult result;
+        validateBSONDocument(data, 0, length, 0, result);
+        return result;
+    }
+
+    /**
+     * @brief Element of a validated buffer, read directly at the offsets found by validateBSONDocument instead
+     * of being parsed again by bsoncxx. It has the accessors of bsoncxx::document::element that get uses,
+     * which throw std::invalid_argument when the element has another type.
+     */
+    class BsonRawElement
+    {
+    public:
+        BsonRawElement(const std::uint8_t* value, std::size_t size, bsoncxx::v_noabi::type type)
+            : value_(value), size_(size), type_(type)
+        {
+        }
+
+        explicit operator bool() const
+        {
+            return true;
+        }
+
+        bsoncxx::v_noabi::type type() const
+        {
+            return type_;
+        }
+
+        bsoncxx::v_noabi::types::b_bool get_bool() const
+        {
+            check(bsoncxx::v_noabi::type::k_bool);
+            return {*value_ != 0};
+        }
+
+        bsoncxx::v_noabi::types::b_int32 get_int32() const
+        {
+            check(bsoncxx::v_noabi::type::k_int32);
+            return {bsonReadInt32(value_)};
+        }
+
+        bsoncxx::v_noabi::types::b_int64 get_int64() const
+        {
+            check(bsoncxx::v_noabi::type::k_int64);
+            std::int64_t value;
+            std::memcpy(&value, value_, sizeof(value));
+            return {value};
+        }
+
+        bsoncxx::v_noabi::types::b_double get_double() const
+        {
+            check(bsoncxx::v_noabi::type::k_double);
+            double value;
+            std::memcpy(&value, value_, sizeof(value));
+            return {value};
+        }
+
+        bsoncxx::v_noabi::types::b_string get_string() const
+        {
+            check(bsoncxx::v_noabi::type::k_string);
+            return bsoncxx::v_noabi::types::b_string{bsoncxx::v_noabi::stdx::string_view(reinterpret_cast<const char*>(value_) + 4, size_ - 5)};
+        }
+
+        bsoncxx::v_noabi::types::b_date get_date() const
+        {
+            check(bsoncxx::v_noabi::type::k_date);
+            std::int64_t millis;
+            std::memcpy(&millis, value_, sizeof(millis));
+            return bsoncxx::v_noabi::types::b_date(std::chrono::milliseconds(millis));
+        }
+
+        bsoncxx::v_noabi::types::b_oid get_oid() const
+        {
+            check(bsoncxx::v_noabi::type::k_oid);
+            return {bsoncxx::v_noabi::oid(reinterpret_cast<const char*>(value_), bsoncxx::v_noabi::oid::size())};
+        }
+
+        bsoncxx::v_noabi::types::b_document get_document() const
+        {
+            check(bsoncxx::v_noabi::type::k_document);
+            return {bsoncxx::v_noabi::document::view(value_, size_)};
+        }
+
+        bsoncxx::v_noabi::types::b_array get_array() const
+        {
+            check(bsoncxx::v_noabi::type::k_array);
+            return {bsoncxx::v_noabi::array::view(value_, size_)};
+        }
+
+    private:
+        void check(bsoncxx::v_noabi::type expected) const
+        {
+            if (type_ != expected)
+            {
+                throw std::invalid_argument("unexpected element type");
+            }
+        }
+
+        const std::uint8_t* value_;
+        std::size_t size_;
+        bsoncxx::v_noabi::type type_;
+    };
+
+    /**
+     * @brief Decode one element into the member of a type defined with BSON_DEFINE_TYPE whose key matches,
+     * looked up through a compile-time perfect hash of the member keys. Elements with unknown keys and
+     * repeated keys are skipped, so that the first occurrence wins as it does with fromBSON.
+     * @param obj Object to decode into
+     * @param seen Members already decoded
+     * @param key Key of the element
+     * @param element Value of the element
+     */
+    template <typename T, std::size_t... I>
+    void decodeBSONMemberElement(T& obj, std::array<bool, sizeof...(I)>& seen, std::string_view key, const BsonRawElement& element, std::index_sequence<I...>)
+    {
+        using Decoder = void (*)(T&, const BsonRawElement&);
+        static constexpr Decoder decoders[] = {
+            [](T& o, const BsonRawElement& e)
+            {
+                constexpr auto member = std::get<I>(T::bsonMembers());
+                o.*(member.pointer) = get<typename decltype(member)::type>(e);
+            }...
+        };
+        static constexpr std::array<BsonEnumEntry<std::size_t>, sizeof...(I)> keys{{{I, std::get<I>(T::bsonMembers()).key}...}};
+        static constexpr auto index = makeBsonEnumIndex(keys);
+
+        const auto* entry = findBsonEnumEntry(keys, index, key);
+        if (entry != nullptr && !seen[entry->value])
+        {
+            seen[entry->value] = true;
+            decoders[entry->value](obj, element);
+        }
+    }
+
+    /**
+     * @brief Validate an untrusted BSON buffer and deserialize it to a C++ type without throwing.
+     * For types defined with BSON_DEFINE_TYPE, validation and decoding are fused into one walk: each
+     * top-level element is decoded into its member as soon as it is validated, from the offsets the validator
+     * found, so top-level elements are not parsed again by bsoncxx nor looked up per member. Sub-documents and
+     * arrays are decoded through bsoncxx views over the validated bytes. Other types are validated and then
+     * decoded with fromBSON.
+     * @tparam T C++ type to deserialize to
+     * @param data Start of the buffer
+     * @param length Size of the buffer
+     * @param out Object to deserialize into, left untouched on failure
+     * @return Result describing why the buffer was rejected, if it was. For type mismatches of fused types,
+     * the offset is the one of the mismatched element.
+     */
+    template <typename T>
+    BsonValidationResult tryFromBSON(const std::uint8_t* data, std::size_t length, T& out)
+    {
+        BsonValidationResult result;
+
+        if constexpr (has_bson_members_v<T>)
+        {
+#ifdef CPP_BSON_CONVERT_INSTRUMENTATION
+            BsonInstrumentationScope bsonInstrumentation{T::bsonTypeName(), BsonOperation::Decode, length};
+#endif
+            constexpr auto memberCount = std::tuple_size_v<decltype(T::bsonMembers())>;
+            T decoded{};
+            std::array<bool, memberCount> seen{};
+
+            validateBSONDocument(data, 0, length, 0, result, [&](std::size_t elementOffset, std::size_t valueOffset, std::size_t valueEnd)
+            {
+                // the key runs from after the type byte to its terminator, just before the value
+                const std::string_view key(reinterpret_cast<const char*>(data) + elementOffset + 1, valueOffset - elementOffset - 2);
+                const BsonRawElement element(data + valueOffset, valueEnd - valueOffset, static_cast<bsoncxx::v_noabi::type>(data[elementOffset]));
+                try
+                {
+                    decodeBSONMemberElement(decoded, seen, key, element, std::make_index_sequence<memberCount>{});
+                }
+                catch (const std::bad_alloc&)
+                {
+                    throw;
+                }
+                catch (const std::exception&)
+                {
+                    result = {BsonValidationError::TypeMismatch, elementOffset};
+                    return false;
+                }
+                return true;
+            });
+
+            if (result)
+            {
+                out = std::move(decoded);
+            }
+            return result;
+        }
+        else
+        {
+            result = validateBSON(data, length);
+            if (!result)
+            {
+                return result;
+            }
+
+            try
+            {
+                out = T::fromBSON(bsoncxx::v_noabi::document::view(data, static_cast<std::size_t>(bsonReadInt32(data))));
+            }
+            catch (const std::bad_alloc&)
+            {
+                throw;
+            }
+            catch (const std::exception&)
+            {
+                result.error = BsonValidationError::TypeMismatch;
+            }
+            return result;
+        }
+    }
+
+    /**
+     * @brief Validate an untrusted BSON document and deserialize it to a C++ type without throwing
+     * @tparam T C++ type to deserialize to
+     * @param doc BSON document to validate and deserialize
+     * @param out Object to deserialize into, left untouched on failure
+     * @return Result describing why the document was rejected, if it was
+     */
+    template <typename T>
+    BsonValidationResult tryFromBSON(const bsoncxx::v_noabi::document::view& doc, T& out)
+    {
+        return tryFromBSON(doc.data(), doc.length(), out);
+    }
+
+#pragma endregion
+
+#pragma region indexed view
+
+    /**
+     * @brief 64-bit FNV-1a hash of a byte string
+     * @param bytes Bytes to hash
+     * @return Hash value
+     */
+    inline std::uint64_t bsonHash(std::string_view bytes)
+    {
+        std::uint64_t hash = 14695981039346656037ULL;
+        for (const auto byte : bytes)
+        {
+            hash = (hash ^ static_cast<std::uint8_t>(byte)) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    /**
+     * @brief Read-only view of a BSON document that indexes its keys once, so that repeated lookups
+     * against the same document don't each scan it linearly. With nested paths enabled, keys of
+     * sub-documents are indexed as well under their dotted path ("outer.inner").
+     * The underlying document must outlive the view.
+     */
+    class BsonIndexedView
+    {
+    public:
+        /**
+         * @brief Index a BSON document
+         * @param doc BSON document to index
+         * @param indexNestedPaths Whether to also index the keys of sub-documents under dotted paths
+         * @param resource Memory resource the index is allocated from
+         */
+        explicit BsonIndexedView(const bsoncxx::v_noabi::document::view& doc, bool indexNestedPaths = false,
+                                 std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+            : doc_(doc), entries_(resource), slots_(resource), paths_(resource)
+        {
+            addEntries(doc, npos, 0, indexNestedPaths);
+
+            std::size_t capacity = 8;
+            while (capacity < entries_.size() * 2)
+            {
+                capacity *= 2;
+            }
+            slots_.assign(capacity, 0);
+            mask_ = capacity - 1;
+
+            for (std::uint32_t i = 0; i < entries_.size(); ++i)
+            {
+                auto slot = entries_[i].hash & mask_;
+                for (; slots_[slot] != 0; slot = (slot + 1) & mask_)
+                {
+                    // keep the first occurrence of a duplicated key, like document::view::find
+                    if (sameKey(entries_[slots_[slot] - 1], entries_[i]))
+                    {
+                        break;
+                    }
+                }
+                if (slots_[slot] == 0)
+                {
+                    slots_[slot] = i + 1;
+                }
+            }
+        }
+
+        /**
+         * @brief Look up a key or dotted path
+         * @param key Key to look up
+         * @return Matching element, or an invalid element if the key is not present
+         */
+        bsoncxx::v_noabi::document::element find(std::string_view key) const
+        {
+            const auto hash = bsonHash(key);
+            for (auto slot = hash & mask_; slots_[slot] != 0; slot = (slot + 1) & mask_)
+            {
+                const auto& entry = entries_[slots_[slot] - 1];
+                if (entry.hash == hash && keyOf(entry) == key)
+                {
+                    return entry.element;
+                }
+            }
+            return {};
+        }
+
+        /**
+         * @return The indexed document
+         */
+        const bsoncxx::v_noabi::document::view& view() const
+        {
+            return doc_;
+        }
+
+        /**
+         * @return Number of indexed keys and paths
+         */
+        std::size_t size() const
+        {
+            return entries_.size();
+        }
+
+    private:
+        static constexpr std::uint32_t npos = 0xFFFFFFFF;
+
+        struct Entry
+        {
+            std::uint64_t hash;
+            std::uint32_t pathOffset; // npos for top-level keys, which are read from the element itself
+            std::uint32_t pathLength;
+            bsoncxx::v_noabi::document::element element;
+        };
+
+        void addEntries(const bsoncxx::v_noabi::document::view& doc, std::uint32_t prefixOffset, std::uint32_t prefixLength, bool indexNestedPaths)
+        {
+            for (const auto& element : doc)
+            {
+                const auto key = element.key();
+                Entry entry{0, npos, 0, element};
+                if (prefixOffset == npos)
+                {
+                    entry.hash = bsonHash(std::string_view(key.data(), key.size()));
+                }
+                else
+                {
+                    entry.pathOffset = static_cast<std::uint32_t>(paths_.size());
+                    paths_.append(paths_, prefixOffset, prefixLength);
+                    paths_.push_back('.');
+                    paths_.append(key.data(), key.size());
+                    entry.pathLength = static_cast<std::uint32_t>(paths_.size()) - entry.pathOffset;
+                    entry.hash = bsonHash(std::string_view(paths_).substr(entry.pathOffset, entry.pathLength));
+                }
+                entries_.push_back(entry);
+
+                if (indexNestedPaths && element.type() == bsoncxx::v_noabi::type::k_document)
+                {
+                    const auto& added = entries_.back();
+                    if (added.pathOffset == npos)
+                    {
+                        const auto offset = static_cast<std::uint32_t>(paths_.size());
+                        paths_.append(key.data(), key.size());
+                        addEntries(element.get_document().value, offset, static_cast<std::uint32_t>(key.size()), true);
+                    }
+                    else
+                    {
+                        addEntries(element.get_document().value, added.pathOffset, added.pathLength, true);
+                    }
+                }
+            }
+        }
+
+        std::string_view keyOf(const Entry& entry) const
+        {
+            if (entry.pathOffset == npos)
+            {
+                const auto key = entry.element.key();
+                return {key.data(), key.size()};
+            }
+            return std::string_view(paths_).substr(entry.pathOffset, entry.pathLength);
+        }
+
+        bool sameKey(const Entry& a, const Entry& b) const
+        {
+            return a.hash == b.hash && keyOf(a) == keyOf(b);
+        }
+
+        bsoncxx::v_noabi::document::view doc_;
+        std::pmr::vector<Entry> entries_;
+        std::pmr::vector<std::uint32_t> slots_; // open addressing table of entry index + 1, 0 when empty
+        std::pmr::string paths_;                // dotted paths of nested keys, back to back
+        std::uint64_t mask_ = 0;
+    };
+
+    /**
+     * @brief Deserialize a key of an indexed BSON document to a C++ type
+     * @tparam T C++ type to deserialize to
+     * @param doc Indexed BSON document
+     * @param key Key or dotted path of the value
+     * @param resource Memory resource used for std::pmr strings and containers, nullptr for the default resource
+     * @return Deserialized C++ type
+     */
+    template <typename T>
+    T get(const BsonIndexedView& doc, std::string_view key, std::pmr::memory_resource* resource = nullptr)
     {
-        if (value.has_value())
+        return get<T>(doc.find(key), resource);
+    }
+
+    /**
+     * @brief Deserialize a member from an indexed BSON document
+     * @tparam T Type of the member
+     * @param member Member to deserialize
+     * @param doc Indexed BSON document to deserialize from
+     * @param key Key or dotted path of the member in the BSON document
+     * @param resource Memory resource used for std::pmr strings and containers, nullptr for the default resource
+     */
+    template <typename T>
+    void deserializeMember(T& member, const BsonIndexedView& doc, const std::string& key, std::pmr::memory_resource* resource = nullptr)
+    {
+        if (const auto element = doc.find(key))
         {
-            serializeMember(doc, key, value.value());
-            return;
+            if (resource == nullptr)
+            {
+                member = get<T>(element);
+            }
+            else
+            {
+                replaceMember(member, get<T>(element, resource));
+            }
         }
-        doc.append(bsoncxx::v_noabi::builder::basic::kvp(key, bsoncxx::v_noabi::types::b_null{}));
     }
 
+#pragma endregion
 
-#define APPEND_MEMBER_TO_DOC(member, doc, name) serializeMember(doc, name, obj.member);
+#pragma region columnar decode
 
-#define RECURSE_TO_BSON_INDIRECT() RECURSE_TO_BSON
-#define RECURSE_TO_BSON() BSON_TO_BSON_1
+    /// Element type a column stores its values as: bool is kept in bytes, since std::vector<bool> is not contiguous
+    template <typename T>
+    using bson_column_storage_t = std::conditional_t<std::is_same_v<T, bool>, std::uint8_t, T>;
 
-#define BSON_TO_BSON_1(class_name, x, ...)       \
-APPEND_MEMBER_TO_DOC(x, doc, #x)                \
-__VA_OPT__(OBSTRUCT(RECURSE_TO_BSON)()(class_name, __VA_ARGS__))
+    /// Type a column returns a row as: a copy for bool, a reference otherwise
+    template <typename T>
+    using bson_column_reference_t = std::conditional_t<std::is_same_v<T, bool>, bool, const T&>;
 
-#define BSON_DEFINE_TO_BSON(class_name, ...)           \
-static bsoncxx::document::value toBSON(const class_name& obj) { \
-bsoncxx::v_noabi::builder::basic::document doc{}; \
-EVAL(BSON_TO_BSON_1(class_name, __VA_ARGS__)) \
-return doc.extract(); \
-}
+    /**
+     * @brief Values of a single member across a range of documents, stored contiguously.
+     * Documents that lack the key get a default-constructed value so that rows of all columns stay aligned.
+     * @tparam T Type of the member
+     */
+    template <typename T>
+    class BsonColumn
+    {
+    public:
+        using value_type = T;
 
-#define BSON_DEFINE_TYPE(class_name, ...)           \
-BSON_DEFINE_FROM_BSON(class_name, __VA_ARGS__) \
-BSON_DEFINE_TO_BSON(class_name, __VA_ARGS__)
+        /**
+         * @param key Key of the member in the BSON documents
+         */
+        explicit BsonColumn(std::string key) : key_(std::move(key))
+        {
+        }
+
+        const std::string& key() const
+        {
+            return key_;
+        }
+
+        const std::vector<bson_column_storage_t<T>>& values() const
+        {
+            return values_;
+        }
+
+        std::size_t size() const
+        {
+            return values_.size();
+        }
+
+        bson_column_reference_t<T> operator[](std::size_t row) const
+        {
+            return values_[row];
+        }
+
+        void reserve(std::size_t rows)
+        {
+            values_.reserve(rows);
+        }
+
+        template <typename Element>
+        void append(const Element& element)
+        {
+            values_.emplace_back(get<T>(element));
+        }
+
+        void appendMissing()
+        {
+            values_.emplace_back();
+        }
+
+        /**
+         * @brief Remove the rows from a given row on
+         * @param rows Number of rows to keep
+         */
+        void truncate(std::size_t rows)
+        {
+            values_.resize(std::min(rows, values_.size()));
+        }
+
+    private:
+        std::string key_;
+        std::vector<bson_column_storage_t<T>> values_;
+    };
+
+    /**
+     * @brief Values of an optional member across a range of documents, with a validity bitmap
+     * whose bit is set for every row that holds a value. Null and missing rows hold a default-constructed value.
+     * @tparam T Type of the member's value
+     */
+    template <typename T>
+    class BsonColumn<std::optional<T>>
+    {
+    public:
+        using value_type = T;
+
+        /**
+         * @param key Key of the member in the BSON documents
+         */
+        explicit BsonColumn(std::string key) : key_(std::move(key))
+        {
+        }
+
+        const std::string& key() const
+        {
+            return key_;
+        }
+
+        const std::vector<bson_column_storage_t<T>>& values() const
+        {
+            return values_;
+        }
+
+        const std::vector<std::uint64_t>& validity() const
+        {
+            return validity_;
+        }
+
+        std::size_t size() const
+        {
+            return values_.size();
+        }
+
+        bool hasValue(std::size_t row) const
+        {
+            return (validity_[row / 64] >> (row % 64)) & 1;
+        }
+
+        bson_column_reference_t<T> operator[](std::size_t row) const
+        {
+            return values_[row];
+        }
+
+        void reserve(std::size_t rows)
+        {
+            values_.reserve(rows);
+            validity_.reserve((rows + 63) / 64);
+        }
+
+        template <typename Element>
+        void append(const Element& element)
+        {
+            if (element.type() == bsoncxx::v_noabi::type::k_null)
+            {
+                appendMissing();
+                return;
+            }
+            values_.emplace_back(get<T>(element));
+            markRow(true);
+        }
+
+        void appendMissing()
+        {
+            values_.emplace_back();
+            markRow(false);
+        }
+
+        /**
+         * @brief Remove the rows from a given row on
+         * @param rows Number of rows to keep
+         */
+        void truncate(std::size_t rows)
+        {
+            if (rows >= values_.size())
+            {
+                return;
+            }
+            values_.resize(rows);
+            validity_.resize((rows + 63) / 64);
+            if (rows % 64 != 0)
+            {
+                validity_.back() &= (std::uint64_t{1} << (rows % 64)) - 1;
+            }
+        }
+
+    private:
+        void markRow(bool valid)
+        {
+            const auto row = values_.size() - 1;
+            if (row % 64 == 0)
+            {
+                validity_.push_back(0);
+            }
+            validity_.back() |= static_cast<std::uint64_t>(valid) << (row % 64);
+        }
+
+        std::string key_;
+        std::vector<bson_column_storage_t<T>> values_;
+        std::vector<std::uint64_t> validity_;
+    };
+
+    template <typename Range, typename = void>
+    struct is_sized_range : std::false_type
+    {
+    };
+
+    template <typename Range>
+    struct is_sized_range<Range, std::void_t<decltype(std::size(std::declval<const Range&>()))>> : std::true_type
+    {
+    };
+
+    template <typename Column, typename Element>
+    std::size_t decodeColumnElement(Column& column, bool& found, std::string_view key, const Element& element)
+    {
+        if (found || column.key() != key)
+        {
+            return 0;
+        }
+        column.append(element);
+        found = true;
+        return 1;
+    }
+
+    /**
+     * @brief Decode a subset of members from a range of BSON documents into one contiguous column per member,
+     * without materializing the objects. Each document is scanned once for all requested keys.
+     * If a value fails to decode, the rows already appended for its document are removed before the exception
+     * propagates, so that all columns hold the rows of the same documents.
+     * @tparam Range Range of bsoncxx::document::view or bsoncxx::document::value
+     * @tparam Columns BsonColumn types to fill
+     * @param documents Documents to decode
+     * @param columns Columns to append one row per document to
+     */
+    template <typename Range, typename... Columns>
+    void decodeColumns(const Range& documents, Columns&... columns)
+    {
+        if constexpr (is_sized_range<Range>::value)
+        {
+            const auto rows = static_cast<std::size_t>(std::size(documents));
+            (columns.reserve(columns.size() + rows), ...);
+        }
+
+        for (const auto& document : documents)
+        {
+            const bsoncxx::v_noabi::document::view doc = document;
+            std::array<bool, sizeof...(Columns)> found{};
+            std::size_t remaining = sizeof...(Columns);
+            const std::array<std::size_t, sizeof...(Columns)> rows{columns.size()...};
+
+            try
+            {
+                for (const auto& element : doc)
+                {
+                    const auto key = element.key();
+                    std::size_t column = 0;
+                    (..., (remaining -= decodeColumnElement(columns, found[column++], std::string_view(key.data(), key.size()), element)));
+                    if (remaining == 0)
+                    {
+                        break;
+                    }
+                }
+
+                std::size_t column = 0;
+                (..., (found[column++] ? void() : columns.appendMissing()));
+            }
+            catch (...)
+            {
+                std::size_t column = 0;
+                (..., columns.truncate(rows[column++]));
+                throw;
+            }
+        }
+    }
+
+// Declares a BsonColumn for a member of a type defined with BSON_DEFINE_TYPE or BSON_DEFINE_COMPACT_TYPE
+#define BSON_COLUMN(class_name, member) BsonColumn<decltype(class_name::member)>(std::string(class_name::bsonKey(#member)))
 
 #pragma endregion
 
+#pragma region stream parsing
+
+    /// Largest document accepted by default by the stream parsers, matching the server limit
+    inline constexpr std::size_t bsonMaxDocumentSize = 16 * 1024 * 1024;
+
+    /**
+     * @brief Push parser for a stream of concatenated BSON documents that arrives in arbitrary chunks.
+     * Documents that are fully contained in a chunk are handed out as views into that chunk. Only a document
+     * that straddles chunk boundaries is copied, and at most one such partial document is held between calls.
+     */
+    class BsonDocumentStream
+    {
+    public:
+        /**
+         * @param maxDocumentSize Largest document length accepted before the stream is considered corrupt
+         */
+        explicit BsonDocumentStream(std::size_t maxDocumentSize = bsonMaxDocumentSize) : maxDocumentSize_(maxDocumentSize)
+        {
+        }
+
+        /**
+         * @brief Consume a chunk of the stream. If a document has a missing terminator or onDocument throws,
+         * the exception propagates after the rest of the chunk has been buffered, and the next call resumes
+         * with the document that follows the failed one. An invalid length prefix means that document boundaries
+         * are lost: the buffer is dropped and the stream fails, rejecting every later chunk without storing it
+         * until reset() is called.
+         * @param data Start of the chunk
+         * @param size Size of the chunk
+         * @param onDocument Called with a bsoncxx::document::view of every document completed by this chunk.
+         * The view is only valid during the call.
+         * @return Number of documents completed by this chunk
+         */
+        template <typename Callback>
+        std::size_t feed(const std::uint8_t* data, std::size_t size, Callback&& onDocument)
+        {
+            if (failed_)
+            {
+                throw std::invalid_argument("BSON stream has an invalid document length, reset() it to resume");
+            }
+            if (resume_)
+            {
+                // after a failure the buffer may hold several documents, so it is processed as a chunk of its own
+                resume_ = false;
+                std::vector<std::uint8_t> chunk;
+                chunk.swap(pending_);
+                chunk.insert(chunk.end(), data, data + size);
+                return feed(chunk.data(), chunk.size(), onDocument);
+            }
+
+            std::size_t count = 0;
+            std::size_t pos = 0;
+
+            try
+            {
+                if (!pending_.empty())
+                {
+                    if (pending_.size() < 4)
+                    {
+                        pos = std::min<std::size_t>(4 - pending_.size(), size);
+                        pending_.insert(pending_.end(), data, data + pos);
+                        if (pending_.size() < 4)
+                        {
+                            return 0;
+                        }
+                        pending_.reserve(documentLength(pending_.data()));
+                    }
+
+                    const auto length = documentLength(pending_.data());
+                    const auto take = std::min(length - pending_.size(), size - pos);
+                    pending_.insert(pending_.end(), data + pos, data + pos + take);
+                    pos += take;
+                    if (pending_.size() < length)
+                    {
+                        return 0;
+                    }
+
+                    std::vector<std::uint8_t> document;
+                    document.swap(pending_);
+                    checkTerminator(document.data(), length);
+                    onDocument(bsoncxx::v_noabi::document::view(document.data(), length));
+                    ++count;
+                    document.clear();
+                    pending_.swap(document);
+                }
+
+                while (size - pos >= 4)
+                {
+                    const auto length = documentLength(data + pos);
+                    if (length > size - pos)
+                    {
+                        break;
+                    }
+                    const auto* document = data + pos;
+                    pos += length;
+                    checkTerminator(document, length);
+                    onDocument(bsoncxx::v_noabi::document::view(document, length));
+                    ++count;
+                }
+            }
+            catch (...)
+            {
+                if (failed_)
+                {
+                    pending_.clear();
+                    pending_.shrink_to_fit();
+                }
+                else
+                {
+                    keepTail(data + pos, size - pos);
+                    resume_ = true;
+                }
+                throw;
+            }
+
+            keepTail(data + pos, size - pos);
+            return count;
+        }
+
+        /**
+         * @return Whether part of a document is buffered, waiting for the next chunk
+         */
+        bool hasPartialDocument() const
+        {
+            return !pending_.empty();
+        }
+
+        /**
+         * @return Number of bytes of the partial document that are buffered
+         */
+        std::size_t bufferedBytes() const
+        {
+            return pending_.size();
+        }
+
+        /**
+         * @return Whether an invalid document length was found, after which chunks are rejected until reset()
+         */
+        bool failed() const
+        {
+            return failed_;
+        }
+
+        /**
+         * @brief Drop any buffered bytes and clear a failure, so that the next chunk starts a new document
+         */
+        void reset()
+        {
+            pending_.clear();
+            pending_.shrink_to_fit();
+            resume_ = false;
+            failed_ = false;
+        }
+
+    private:
+        void keepTail(const std::uint8_t* data, std::size_t size)
+        {
+            if (size == 0)
+            {
+                return;
+            }
+            pending_.insert(pending_.end(), data, data + size);
+            if (pending_.size() >= 4)
+            {
+                const auto length = bsonReadInt32(pending_.data());
+                if (length >= 5 && static_cast<std::size_t>(length) <= maxDocumentSize_)
+                {
+                    pending_.reserve(static_cast<std::size_t>(length));
+                }
+            }
+        }
+
+        std::size_t documentLength(const std::uint8_t* data)
+        {
+            const auto length = bsonReadInt32(data);
+            if (length < 5 || static_cast<std::size_t>(length) > maxDocumentSize_)
+            {
+                failed_ = true;
+                throw std::invalid_argument("invalid BSON document length");
+            }
+            return static_cast<std::size_t>(length);
+        }
+
+        static void checkTerminator(const std::uint8_t* data, std::size_t length)
+        {
+            if (data[length - 1] != 0)
+            {
+                throw std::invalid_argument("missing BSON document terminator");
+            }
+        }
+
+        std::size_t maxDocumentSize_;
+        std::vector<std::uint8_t> pending_;
+        bool resume_ = false;
+        bool failed_ = false;
+    };
+
+    /**
+     * @brief Push parser that decodes a chunked stream of concatenated BSON documents to a C++ type
+     * @tparam T C++ type to deserialize to, defined with BSON_DEFINE_TYPE
+     */
+    template <typename T>
+    class BsonStreamParser
+    {
+    public:
+        /**
+         * @param maxDocumentSize Largest document length accepted before the stream is considered corrupt
+         */
+        explicit BsonStreamParser(std::size_t maxDocumentSize = bsonMaxDocumentSize) : stream_(maxDocumentSize)
+        {
+        }
+
+        /**
+         * @brief Consume a chunk of the stream
+         * @param data Start of the chunk
+         * @param size Size of the chunk
+         * @param onObject Called with every object completed by this chunk
+         * @return Number of objects completed by this chunk
+         */
+        template <typename Callback>
+        std::size_t feed(const std::uint8_t* data, std::size_t size, Callback&& onObject)
+        {
+            return stream_.feed(data, size, [&onObject](const bsoncxx::v_noabi::document::view& doc)
+            {
+                onObject(T::fromBSON(doc));
+            });
+        }
+
+        bool hasPartialDocument() const
+        {
+            return stream_.hasPartialDocument();
+        }
+
+        std::size_t bufferedBytes() const
+        {
+            return stream_.bufferedBytes();
+        }
+
+        bool failed() const
+        {
+            return stream_.failed();
+        }
+
+        void reset()
+        {
+            stream_.reset();
+        }
+
+    private:
+        BsonDocumentStream stream_;
+    };
+
+#pragma endregion
 
 #endif //CPP_BSON_CONVERT_HPP
@@ -0,0 +1,415 @@
+/*
+
+Modern Bson Serialization/Deserialization library for C++ (17+)
+version 1.2.2
+https://github.com/sertaceker/cpp-bson-convert
+
+If you encounter any issues, please submit a ticket at https://github.com/sertaceker/cpp-bson-convert/issues
+
+MIT License
+
+Copyright (c) 2024 sertaceker
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef CPP_BSON_DUMP_INDEX_HPP
+#define CPP_BSON_DUMP_INDEX_HPP
+
+// Random-access index of .bson dump files. Kept apart from cpp-bson-convert.hpp because it needs POSIX
+// memory mapping and threads.
+
+#include "cpp-bson-convert.hpp"
+
+#include <exception>
+#include <fstream>
+#include <thread>
+
+#if !defined(__unix__) && !defined(__APPLE__)
+#error "cpp-bson-dump-index.hpp requires a POSIX platform"
+#endif
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#pragma region dump index
+
+    /**
+     * @brief Read-only memory mapping of a file. Pages are only read from disk when they are touched.
+     */
+    class BsonMappedFile
+    {
+    public:
+        /**
+         * @param path Path of the file to map
+         */
+        explicit BsonMappedFile(const std::string& path)
+        {
+            const int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                throw std::runtime_error("cannot open " + path);
+            }
+            struct stat st{};
+            if (::fstat(fd, &st) != 0)
+            {
+                ::close(fd);
+                throw std::runtime_error("cannot stat " + path);
+            }
+            size_ = static_cast<std::size_t>(st.st_size);
+            if (size_ > 0)
+            {
+                void* mapping = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapping == MAP_FAILED)
+                {
+                    ::close(fd);
+                    throw std::runtime_error("cannot map " + path);
+                }
+                data_ = static_cast<const std::uint8_t*>(mapping);
+            }
+            ::close(fd);
+        }
+
+        BsonMappedFile(const BsonMappedFile&) = delete;
+        BsonMappedFile& operator=(const BsonMappedFile&) = delete;
+
+        BsonMappedFile(BsonMappedFile&& other) noexcept : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0))
+        {
+        }
+
+        BsonMappedFile& operator=(BsonMappedFile&& other) noexcept
+        {
+            if (this != &other)
+            {
+                unmap();
+                data_ = std::exchange(other.data_, nullptr);
+                size_ = std::exchange(other.size_, 0);
+            }
+            return *this;
+        }
+
+        ~BsonMappedFile()
+        {
+            unmap();
+        }
+
+        const std::uint8_t* data() const
+        {
+            return data_;
+        }
+
+        std::size_t size() const
+        {
+            return size_;
+        }
+
+    private:
+        void unmap()
+        {
+            if (data_ != nullptr)
+            {
+                ::munmap(const_cast<std::uint8_t*>(data_), size_);
+            }
+        }
+
+        const std::uint8_t* data_ = nullptr;
+        std::size_t size_ = 0;
+    };
+
+    /**
+     * @brief Entry of a dump index: where the document with a given _id hash is stored in the dump
+     */
+    struct BsonDumpIndexEntry
+    {
+        std::uint64_t hash;
+        std::uint64_t offset;
+        std::uint32_t length;
+        std::uint32_t reserved;
+    };
+
+    /**
+     * @brief Bytes of the _id element of a document, from its type byte to the end of its value
+     * @param doc BSON document
+     * @return Bytes of the element, empty if the document has no _id
+     */
+    inline std::string_view bsonIdElement(const bsoncxx::v_noabi::document::view& doc)
+    {
+        for (auto it = doc.begin(); it != doc.end(); ++it)
+        {
+            if (it->key() == "_id")
+            {
+                const auto* start = it->raw() + it->offset();
+                auto next = it;
+                ++next;
+                const auto* end = next != doc.end() ? next->raw() + next->offset() : doc.data() + doc.length() - 1;
+                return std::string_view(reinterpret_cast<const char*>(start), static_cast<std::size_t>(end - start));
+            }
+        }
+        return {};
+    }
+
+    /**
+     * @brief Random-access index of a .bson dump, a file of concatenated BSON documents, keyed by _id.
+     * The index is a sorted array of (hash of _id, offset, length) entries that can be saved to a sidecar
+     * file. Lookups binary search it and then read only the bytes of the matching document from the mapped dump.
+     *
+     * The sidecar file holds three std::uint64_t, the magic "BSBINDX1", the size of the dump and the number of
+     * entries, followed by the entries as BsonDumpIndexEntry structs sorted by hash, then offset. Everything is
+     * written in host byte order, so an index is only readable on hosts of the same endianness; on others the
+     * magic does not match and load rejects the file.
+     */
+    class BsonDumpIndex
+    {
+    public:
+        /**
+         * @param dumpPath Path of the .bson dump
+         */
+        explicit BsonDumpIndex(const std::string& dumpPath) : file_(dumpPath)
+        {
+        }
+
+        /**
+         * @brief Scan the dump and index every document by _id. Document boundaries are found by following the
+         * length prefixes, after which the documents are split into one region per thread, and the _id of each
+         * region is located and hashed in parallel.
+         * @param threadCount Number of threads, 0 for one per hardware thread
+         * @throws std::invalid_argument if the dump is corrupt or a document has no _id
+         */
+        void build(unsigned threadCount = 0)
+        {
+            const auto* data = file_.data();
+            const auto size = file_.size();
+
+            std::vector<BsonDumpIndexEntry> entries;
+            std::size_t pos = 0;
+            while (pos < size)
+            {
+                const auto length = size - pos >= 4 ? bsonReadInt32(data + pos) : 0;
+                if (length < 5 || static_cast<std::size_t>(length) > size - pos || static_cast<std::size_t>(length) > bsonMaxDocumentSize)
+                {
+                    throw std::invalid_argument("invalid BSON document length at offset " + std::to_string(pos));
+                }
+                entries.push_back({0, pos, static_cast<std::uint32_t>(length), 0});
+                pos += length;
+            }
+
+            if (threadCount == 0)
+            {
+                threadCount = std::max(1u, std::thread::hardware_concurrency());
+            }
+            threadCount = static_cast<unsigned>(std::min<std::size_t>(threadCount, std::max<std::size_t>(1, entries.size())));
+            const auto regionSize = (entries.size() + threadCount - 1) / threadCount;
+
+            std::vector<std::exception_ptr> errors(threadCount);
+            const auto hashRegion = [&](unsigned region)
+            {
+                try
+                {
+                    const auto end = std::min(entries.size(), (region + 1) * regionSize);
+                    for (auto i = region * regionSize; i < end; ++i)
+                    {
+                        auto& entry = entries[i];
+                        if (data[entry.offset + entry.length - 1] != 0)
+                        {
+                            throw std::invalid_argument("missing BSON document terminator at offset " + std::to_string(entry.offset));
+                        }
+                        const auto id = bsonIdElement(bsoncxx::v_noabi::document::view(data + entry.offset, entry.length));
+                        if (id.empty())
+                        {
+                            throw std::invalid_argument("document without _id at offset " + std::to_string(entry.offset));
+                        }
+                        entry.hash = bsonHash(id);
+                    }
+                }
+                catch (...)
+                {
+                    errors[region] = std::current_exception();
+                }
+            };
+
+            std::vector<std::thread> threads;
+            try
+            {
+                threads.reserve(threadCount - 1);
+                for (unsigned region = 1; region < threadCount; ++region)
+                {
+                    threads.emplace_back(hashRegion, region);
+                }
+            }
+            catch (...)
+            {
+                // destroying a joinable thread terminates the program
+                for (auto& thread : threads)
+                {
+                    thread.join();
+                }
+                throw;
+            }
+            hashRegion(0);
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+            for (const auto& error : errors)
+            {
+                if (error)
+                {
+                    std::rethrow_exception(error);
+                }
+            }
+
+            std::sort(entries.begin(), entries.end(), [](const BsonDumpIndexEntry& a, const BsonDumpIndexEntry& b)
+            {
+                return a.hash != b.hash ? a.hash < b.hash : a.offset < b.offset;
+            });
+            entries_ = std::move(entries);
+        }
+
+        /**
+         * @brief Write the index to a sidecar file
+         * @param indexPath Path of the index file
+         */
+        void save(const std::string& indexPath) const
+        {
+            std::ofstream out(indexPath, std::ios::binary | std::ios::trunc);
+            const std::uint64_t header[] = {indexMagic, file_.size(), entries_.size()};
+            out.write(reinterpret_cast<const char*>(header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(entries_.data()), static_cast<std::streamsize>(entries_.size() * sizeof(BsonDumpIndexEntry)));
+            if (!out)
+            {
+                throw std::runtime_error("cannot write " + indexPath);
+            }
+        }
+
+        /**
+         * @brief Read an index written by save, instead of scanning the dump again
+         * @param indexPath Path of the index file
+         * @throws std::runtime_error if the index is unreadable, corrupt, or was built for a dump of a different
+         * size
+         */
+        void load(const std::string& indexPath)
+        {
+            std::ifstream in(indexPath, std::ios::binary | std::ios::ate);
+            const auto fileSize = static_cast<std::uint64_t>(std::max<std::streamoff>(0, in.tellg()));
+            in.seekg(0);
+            std::uint64_t header[3] = {};
+            in.read(reinterpret_cast<char*>(header), sizeof(header));
+            if (!in || header[0] != indexMagic || header[1] != file_.size())
+            {
+                throw std::runtime_error("invalid or stale dump index " + indexPath);
+            }
+            // checked against the file size before allocating, so that a corrupt count cannot request any amount
+            if (header[2] != (fileSize - sizeof(header)) / sizeof(BsonDumpIndexEntry) ||
+                (fileSize - sizeof(header)) % sizeof(BsonDumpIndexEntry) != 0)
+            {
+                throw std::runtime_error("truncated dump index " + indexPath);
+            }
+
+            std::vector<BsonDumpIndexEntry> entries(static_cast<std::size_t>(header[2]));
+            in.read(reinterpret_cast<char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(BsonDumpIndexEntry)));
+            if (!in)
+            {
+                throw std::runtime_error("truncated dump index " + indexPath);
+            }
+            for (std::size_t i = 0; i < entries.size(); ++i)
+            {
+                const auto& entry = entries[i];
+                if (entry.length < 5 || entry.offset > file_.size() || entry.length > file_.size() - entry.offset)
+                {
+                    throw std::runtime_error("invalid dump index entry in " + indexPath);
+                }
+                // find binary searches the entries, so an unsorted index would silently miss documents
+                if (i > 0 && (entries[i - 1].hash > entry.hash || (entries[i - 1].hash == entry.hash && entries[i - 1].offset >= entry.offset)))
+                {
+                    throw std::runtime_error("unsorted dump index " + indexPath);
+                }
+            }
+            entries_ = std::move(entries);
+        }
+
+        /**
+         * @return Number of indexed documents
+         */
+        std::size_t size() const
+        {
+            return entries_.size();
+        }
+
+        /**
+         * @brief Find the document with the given _id
+         * @tparam Key Type of the _id, any type supported by serializeMember
+         * @param id Value of the _id
+         * @return View of the document in the mapped dump, or std::nullopt if there is none
+         */
+        template <typename Key>
+        std::optional<bsoncxx::v_noabi::document::view> find(const Key& id) const
+        {
+            bsoncxx::v_noabi::builder::basic::document key{};
+            serializeMember(key, "_id", id);
+            const auto keyValue = key.extract();
+            const auto keyView = keyValue.view();
+            const auto element = std::string_view(reinterpret_cast<const char*>(keyView.data()) + 4, keyView.length() - 5);
+            const auto hash = bsonHash(element);
+
+            auto it = std::lower_bound(entries_.begin(), entries_.end(), hash, [](const BsonDumpIndexEntry& entry, std::uint64_t h)
+            {
+                return entry.hash < h;
+            });
+            for (; it != entries_.end() && it->hash == hash; ++it)
+            {
+                const bsoncxx::v_noabi::document::view doc(file_.data() + it->offset, it->length);
+                if (bsonIdElement(doc) == element)
+                {
+                    return doc;
+                }
+            }
+            return std::nullopt;
+        }
+
+        /**
+         * @brief Find the document with the given _id and deserialize it
+         * @tparam T C++ type to deserialize to, defined with BSON_DEFINE_TYPE
+         * @tparam Key Type of the _id
+         * @param id Value of the _id
+         * @return Deserialized document, or std::nullopt if there is none
+         */
+        template <typename T, typename Key>
+        std::optional<T> lookup(const Key& id) const
+        {
+            if (const auto doc = find(id))
+            {
+                return T::fromBSON(*doc);
+            }
+            return std::nullopt;
+        }
+
+    private:
+        static constexpr std::uint64_t indexMagic = 0x3158444e49425342ULL; // "BSBINDX1"
+
+        BsonMappedFile file_;
+        std::vector<BsonDumpIndexEntry> entries_;
+    };
+
+#pragma endregion
+
+
+#endif //CPP_BSON_DUMP_INDEX_HPP
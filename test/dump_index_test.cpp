@@ -0,0 +1,109 @@
+#include "cpp-bson-dump-index.hpp"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+TEST(DumpIndexTest, LookupById)
+{
+    struct Record
+    {
+        bsoncxx::oid _id;
+        std::string name;
+        int value;
+
+        BSON_DEFINE_TYPE(Record, _id, name, value)
+    };
+
+    const auto dumpPath = ::testing::TempDir() + "dump_index_test.bson";
+    const auto indexPath = dumpPath + ".idx";
+
+    std::vector<Record> records;
+    {
+        std::ofstream out(dumpPath, std::ios::binary | std::ios::trunc);
+        for (int i = 0; i < 100; ++i)
+        {
+            records.push_back(Record{bsoncxx::oid(), "record" + std::to_string(i), i});
+            const auto bson = Record::toBSON(records.back());
+            out.write(reinterpret_cast<const char*>(bson.view().data()), static_cast<std::streamsize>(bson.view().length()));
+        }
+    }
+
+    BsonDumpIndex index(dumpPath);
+    index.build(3);
+    ASSERT_EQ(index.size(), 100u);
+    index.save(indexPath);
+
+    BsonDumpIndex loaded(dumpPath);
+    loaded.load(indexPath);
+    ASSERT_EQ(loaded.size(), 100u);
+
+    for (const auto& record : {records[0], records[57], records[99]})
+    {
+        const auto found = loaded.lookup<Record>(record._id);
+        ASSERT_TRUE(found.has_value());
+        ASSERT_EQ(found->name, record.name);
+        ASSERT_EQ(found->value, record.value);
+    }
+    ASSERT_FALSE(loaded.find(bsoncxx::oid()).has_value());
+
+    std::remove(dumpPath.c_str());
+    std::remove(indexPath.c_str());
+}
+
+TEST(DumpIndexTest, RejectsCorruptIndex)
+{
+    const auto dumpPath = ::testing::TempDir() + "dump_index_corrupt_test.bson";
+    const auto indexPath = dumpPath + ".idx";
+
+    {
+        std::ofstream out(dumpPath, std::ios::binary | std::ios::trunc);
+        for (int i = 0; i < 10; ++i)
+        {
+            bsoncxx::builder::basic::document doc{};
+            doc.append(bsoncxx::builder::basic::kvp("_id", i));
+            const auto bson = doc.extract();
+            out.write(reinterpret_cast<const char*>(bson.view().data()), static_cast<std::streamsize>(bson.view().length()));
+        }
+    }
+
+    BsonDumpIndex index(dumpPath);
+    index.build(2);
+    index.save(indexPath);
+
+    std::vector<char> saved;
+    {
+        std::ifstream in(indexPath, std::ios::binary);
+        saved.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    ASSERT_EQ(saved.size(), 3 * sizeof(std::uint64_t) + 10 * sizeof(BsonDumpIndexEntry));
+    const auto writeIndex = [&indexPath](const std::vector<char>& bytes)
+    {
+        std::ofstream out(indexPath, std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    };
+
+    auto hugeCount = saved;
+    const std::uint64_t count = 1ULL << 60;
+    std::memcpy(hugeCount.data() + 2 * sizeof(std::uint64_t), &count, sizeof(count));
+    writeIndex(hugeCount);
+    BsonDumpIndex loaded(dumpPath);
+    ASSERT_THROW(loaded.load(indexPath), std::runtime_error);
+
+    auto unsorted = saved;
+    auto* entries = unsorted.data() + 3 * sizeof(std::uint64_t);
+    std::swap_ranges(entries, entries + sizeof(BsonDumpIndexEntry), entries + sizeof(BsonDumpIndexEntry));
+    writeIndex(unsorted);
+    ASSERT_THROW(loaded.load(indexPath), std::runtime_error);
+
+    writeIndex(saved);
+    loaded.load(indexPath);
+    ASSERT_EQ(loaded.size(), 10u);
+    ASSERT_TRUE(loaded.find(7).has_value());
+
+    std::remove(dumpPath.c_str());
+    std::remove(indexPath.c_str());
+}
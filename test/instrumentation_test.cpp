@@ -0,0 +1,119 @@
+#define CPP_BSON_CONVERT_INSTRUMENTATION
+#include "cpp-bson-convert.hpp"
+
+#include <gtest/gtest.h>
+
+namespace
+{
+    std::vector<BsonInstrumentationEvent> capturedEvents;
+
+    void captureEvent(const BsonInstrumentationEvent& event)
+    {
+        capturedEvents.push_back(event);
+    }
+}
+
+TEST(InstrumentationTest, AggregatesPerType)
+{
+    struct Telemetry
+    {
+        int sensor;
+        double value;
+
+        BSON_DEFINE_TYPE(Telemetry, sensor, value)
+    };
+
+    resetBsonStats();
+
+    Telemetry telemetry{7, 21.5};
+    const auto bson = Telemetry::toBSON(telemetry);
+    Telemetry::fromBSON(bson);
+    Telemetry::fromBSON(bson);
+
+    const auto snapshot = bsonStatsSnapshot();
+    const auto it = snapshot.find("Telemetry");
+    ASSERT_NE(it, snapshot.end());
+    ASSERT_EQ(it->second.encodeCount, 1u);
+    ASSERT_EQ(it->second.decodeCount, 2u);
+    ASSERT_EQ(it->second.encodedBytes, bson.view().length());
+    ASSERT_EQ(it->second.decodedBytes, 2 * bson.view().length());
+    ASSERT_EQ(it->second.maxDecodedBytes, bson.view().length());
+
+    std::uint64_t decodeSamples = 0;
+    for (const auto count : it->second.decodeLatency)
+    {
+        decodeSamples += count;
+    }
+    ASSERT_EQ(decodeSamples, 2u);
+}
+
+TEST(InstrumentationTest, CustomSink)
+{
+    struct Outer
+    {
+        struct Inner
+        {
+            int x;
+
+            BSON_DEFINE_TYPE(Inner, x)
+        };
+
+        Inner inner;
+        std::string name;
+
+        BSON_DEFINE_TYPE(Outer, inner, name)
+    };
+
+    capturedEvents.clear();
+    setBsonInstrumentationSink(&captureEvent);
+    const auto bson = Outer::toBSON(Outer{{1}, "outer"});
+    setBsonInstrumentationSink(&recordBsonStats);
+
+    ASSERT_EQ(capturedEvents.size(), 2u);
+    ASSERT_STREQ(capturedEvents[0].typeName, "Inner");
+    ASSERT_STREQ(capturedEvents[1].typeName, "Outer");
+    ASSERT_EQ(capturedEvents[1].operation, BsonOperation::Encode);
+    ASSERT_EQ(capturedEvents[1].bytes, bson.view().length());
+}
+
+TEST(InstrumentationTest, VariantAlternatives)
+{
+    struct Created
+    {
+        std::string name;
+
+        BSON_DEFINE_TYPE(Created, name)
+    };
+
+    struct Deleted
+    {
+        int id;
+
+        BSON_DEFINE_TYPE(Deleted, id)
+    };
+
+    struct Event
+    {
+        std::variant<Created, Deleted> payload;
+
+        BSON_DEFINE_TYPE(Event, payload)
+    };
+
+    capturedEvents.clear();
+    setBsonInstrumentationSink(&captureEvent);
+    const auto bson = Event::toBSON(Event{Created{"created"}});
+    Event::fromBSON(bson);
+    setBsonInstrumentationSink(&recordBsonStats);
+
+    std::size_t encodes = 0;
+    std::size_t decodes = 0;
+    for (const auto& event : capturedEvents)
+    {
+        if (std::string(event.typeName) == "Created")
+        {
+            (event.operation == BsonOperation::Encode ? encodes : decodes)++;
+        }
+    }
+    ASSERT_EQ(encodes, 1u);
+    ASSERT_EQ(decodes, 1u);
+}
@@ -558,4 +558,914 @@ TEST(Optional, Deserialization)
     ASSERT_EQ(deserialized.optionalStringArray, std::nullopt);
     ASSERT_EQ(deserialized.optionalInner, std::nullopt);
 
-}
\ No newline at end of file
+}
+
+TEST(ValidationTest, ValidDocument)
+{
+    struct Message
+    {
+        int id;
+        std::string text;
+        std::vector<std::string> tags;
+
+        BSON_DEFINE_TYPE(Message, id, text, tags)
+    };
+
+    Message message{7, "gr\xC3\xBC\xC3\x9F" "e aus K\xC3\xB6ln, a long enough ascii run to use the vector path", {"one", "\xE2\x82\xAC"}};
+    const auto bson = Message::toBSON(message);
+
+    Message decoded{};
+    const auto result = tryFromBSON(bson.view(), decoded);
+
+    ASSERT_TRUE(result);
+    ASSERT_EQ(message.id, decoded.id);
+    ASSERT_EQ(message.text, decoded.text);
+    ASSERT_EQ(message.tags, decoded.tags);
+}
+
+TEST(ValidationTest, InvalidDocuments)
+{
+    struct Message
+    {
+        int id;
+        std::string text;
+
+        BSON_DEFINE_TYPE(Message, id, text)
+    };
+
+    const auto bson = Message::toBSON(Message{7, "text"});
+    const std::vector<std::uint8_t> bytes(bson.view().data(), bson.view().data() + bson.view().length());
+    Message decoded{};
+
+    ASSERT_EQ(tryFromBSON(bytes.data(), bytes.size() - 1, decoded).error, BsonValidationError::InvalidLength);
+
+    auto missingTerminator = bytes;
+    missingTerminator.back() = 1;
+    ASSERT_EQ(tryFromBSON(missingTerminator.data(), missingTerminator.size(), decoded).error, BsonValidationError::MissingTerminator);
+
+    auto invalidType = bytes;
+    invalidType[4] = 0x42;
+    ASSERT_EQ(tryFromBSON(invalidType.data(), invalidType.size(), decoded).error, BsonValidationError::InvalidType);
+
+    auto invalidUtf8 = bytes;
+    invalidUtf8[invalidUtf8.size() - 3] = 0xC0;
+    ASSERT_EQ(tryFromBSON(invalidUtf8.data(), invalidUtf8.size(), decoded).error, BsonValidationError::InvalidUtf8);
+
+    bsoncxx::builder::basic::document mismatched{};
+    mismatched.append(bsoncxx::builder::basic::kvp("id", "not a number"));
+    ASSERT_EQ(tryFromBSON(mismatched.view(), decoded).error, BsonValidationError::TypeMismatch);
+    ASSERT_EQ(decoded.id, 0);
+}
+
+TEST(ValidationTest, FusedDecode)
+{
+    struct Message
+    {
+        int id;
+        std::string text;
+
+        BSON_DEFINE_TYPE(Message, id, text)
+    };
+
+    bsoncxx::builder::basic::document doc{};
+    doc.append(bsoncxx::builder::basic::kvp("unknown", 1.5));
+    doc.append(bsoncxx::builder::basic::kvp("id", 3));
+    doc.append(bsoncxx::builder::basic::kvp("text", "first"));
+    doc.append(bsoncxx::builder::basic::kvp("text", "second"));
+    const auto value = doc.extract();
+
+    Message decoded{};
+    ASSERT_TRUE(tryFromBSON(value.view(), decoded));
+    ASSERT_EQ(decoded.id, 3);
+    ASSERT_EQ(decoded.text, "first");
+
+    bsoncxx::builder::basic::document mismatched{};
+    mismatched.append(bsoncxx::builder::basic::kvp("id", 4));
+    mismatched.append(bsoncxx::builder::basic::kvp("text", 5));
+    const auto mismatchedValue = mismatched.extract();
+
+    // 4 byte length, then type, "id\0" and an int32 before the second element
+    const auto result = tryFromBSON(mismatchedValue.view(), decoded);
+    ASSERT_EQ(result.error, BsonValidationError::TypeMismatch);
+    ASSERT_EQ(result.offset, 4u + 1u + 3u + 4u);
+    ASSERT_EQ(decoded.id, 3);
+    ASSERT_EQ(decoded.text, "first");
+}
+
+TEST(ValidationTest, FusedDecodeMemberTypes)
+{
+    struct Inner
+    {
+        int value;
+
+        BSON_DEFINE_TYPE(Inner, value)
+    };
+
+    struct AllTypes
+    {
+        bsoncxx::oid id;
+        bool boolean;
+        std::int64_t largeInteger;
+        double floatingPoint;
+        std::chrono::system_clock::time_point timestamp;
+        std::vector<int> intArray;
+        std::optional<int> optionalInt;
+        std::optional<std::string> optionalString;
+        Inner inner;
+        std::vector<Inner> innerArray;
+
+        BSON_DEFINE_TYPE(AllTypes, id, boolean, largeInteger, floatingPoint, timestamp, intArray, optionalInt, optionalString, inner, innerArray)
+    };
+
+    AllTypes allTypes{};
+    allTypes.id = bsoncxx::oid();
+    allTypes.boolean = true;
+    allTypes.largeInteger = 1LL << 40;
+    allTypes.floatingPoint = 3.14;
+    allTypes.timestamp = std::chrono::system_clock::time_point(std::chrono::milliseconds(1700000000000));
+    allTypes.intArray = {1, 2, 3};
+    allTypes.optionalInt = 42;
+    allTypes.inner = {5};
+    allTypes.innerArray = {{6}, {7}};
+    const auto bson = AllTypes::toBSON(allTypes);
+
+    AllTypes decoded{};
+    ASSERT_TRUE(tryFromBSON(bson.view(), decoded));
+    ASSERT_EQ(allTypes.id, decoded.id);
+    ASSERT_EQ(allTypes.boolean, decoded.boolean);
+    ASSERT_EQ(allTypes.largeInteger, decoded.largeInteger);
+    ASSERT_EQ(allTypes.floatingPoint, decoded.floatingPoint);
+    ASSERT_EQ(allTypes.timestamp, decoded.timestamp);
+    ASSERT_EQ(allTypes.intArray, decoded.intArray);
+    ASSERT_EQ(allTypes.optionalInt, decoded.optionalInt);
+    ASSERT_EQ(allTypes.optionalString, decoded.optionalString);
+    ASSERT_EQ(allTypes.inner.value, decoded.inner.value);
+    ASSERT_EQ(decoded.innerArray.size(), 2u);
+    ASSERT_EQ(decoded.innerArray[1].value, 7);
+}
+
+TEST(IndexedViewTest, Lookup)
+{
+    bsoncxx::builder::basic::document inner{};
+    inner.append(bsoncxx::builder::basic::kvp("enabled", true));
+    inner.append(bsoncxx::builder::basic::kvp("ratio", 0.25));
+
+    bsoncxx::builder::basic::document doc{};
+    doc.append(bsoncxx::builder::basic::kvp("name", "routing"));
+    doc.append(bsoncxx::builder::basic::kvp("priority", 3));
+    doc.append(bsoncxx::builder::basic::kvp("flags", inner.view()));
+    doc.append(bsoncxx::builder::basic::kvp("priority", 4));
+    const auto value = doc.extract();
+
+    const BsonIndexedView flat(value.view());
+    ASSERT_EQ(flat.size(), 4u);
+    ASSERT_EQ(get<std::string>(flat, "name"), "routing");
+    ASSERT_EQ(get<int>(flat, "priority"), 3);
+    ASSERT_FALSE(flat.find("flags.enabled"));
+    ASSERT_FALSE(flat.find("missing"));
+
+    std::pmr::monotonic_buffer_resource pool;
+    const BsonIndexedView nested(value.view(), true, &pool);
+    ASSERT_EQ(nested.size(), 6u);
+    ASSERT_TRUE(get<bool>(nested, "flags.enabled"));
+    ASSERT_EQ(get<double>(nested, "flags.ratio"), 0.25);
+    ASSERT_EQ(get<std::optional<int>>(nested, "missing"), std::nullopt);
+
+    int priority = 0;
+    std::string name;
+    std::optional<double> missing;
+    deserializeMember(priority, nested, "priority");
+    deserializeMember(name, nested, "name");
+    deserializeMember(missing, nested, "flags.missing");
+    ASSERT_EQ(priority, 3);
+    ASSERT_EQ(name, "routing");
+    ASSERT_EQ(missing, std::nullopt);
+}
+
+TEST(VariantTest, Serialization)
+{
+    struct Created
+    {
+        std::string name;
+
+        BSON_DEFINE_TYPE(Created, name)
+    };
+
+    struct Moved
+    {
+        int x;
+        int y;
+
+        BSON_DEFINE_TYPE(Moved, x, y)
+    };
+
+    struct Event
+    {
+        std::variant<Created, Moved> payload;
+
+        BSON_DEFINE_TYPE(Event, payload)
+    };
+
+    const auto bson = Event::toBSON(Event{Moved{3, 4}});
+    const auto payload = bson["payload"].get_document().value;
+
+    ASSERT_EQ(std::string(payload.begin()->key()), BSON_VARIANT_DISCRIMINATOR);
+    ASSERT_EQ(std::string(payload[BSON_VARIANT_DISCRIMINATOR].get_string().value), "Moved");
+    ASSERT_EQ(payload["x"].get_int32().value, 3);
+    ASSERT_EQ(payload["y"].get_int32().value, 4);
+}
+
+TEST(VariantTest, Deserialization)
+{
+    struct Created
+    {
+        std::string name;
+
+        BSON_DEFINE_TYPE(Created, name)
+    };
+
+    struct Moved
+    {
+        int x;
+        int y;
+
+        BSON_DEFINE_TYPE(Moved, x, y)
+    };
+
+    struct Stream
+    {
+        std::variant<Created, Moved> last;
+        std::vector<std::variant<Created, Moved>> events;
+        std::optional<std::variant<Created, Moved>> pending;
+
+        BSON_DEFINE_TYPE(Stream, last, events, pending)
+    };
+
+    Stream stream;
+    stream.last = Created{"first"};
+    stream.events = {Moved{1, 2}, Created{"second"}, Moved{5, 6}};
+
+    const auto bson = Stream::toBSON(stream);
+    const auto deserialized = Stream::fromBSON(bson);
+
+    ASSERT_EQ(std::get<Created>(deserialized.last).name, "first");
+    ASSERT_EQ(deserialized.events.size(), 3u);
+    ASSERT_EQ(std::get<Moved>(deserialized.events[0]).x, 1);
+    ASSERT_EQ(std::get<Moved>(deserialized.events[0]).y, 2);
+    ASSERT_EQ(std::get<Created>(deserialized.events[1]).name, "second");
+    ASSERT_EQ(std::get<Moved>(deserialized.events[2]).y, 6);
+    ASSERT_EQ(deserialized.pending, std::nullopt);
+
+    bsoncxx::builder::basic::document unknown{};
+    unknown.append(bsoncxx::builder::basic::kvp(BSON_VARIANT_DISCRIMINATOR, "Deleted"));
+    bsoncxx::builder::basic::document doc{};
+    doc.append(bsoncxx::builder::basic::kvp("last", unknown.view()));
+    ASSERT_THROW(Stream::fromBSON(doc.view()), std::invalid_argument);
+}
+
+enum class Priority
+{
+    Low,
+    Medium,
+    High
+};
+
+enum class Status
+{
+    Active = 1,
+    Suspended = 5,
+    Deleted = 9
+};
+
+BSON_DEFINE_ENUM(Status, Active, Suspended, Deleted)
+
+enum Region
+{
+    AfSouth1, ApEast1, ApNortheast1, ApNortheast2, ApNortheast3, ApSouth1, ApSouth2, ApSoutheast1, ApSoutheast2,
+    ApSoutheast3, ApSoutheast4, CaCentral1, CaWest1, EuCentral1, EuCentral2, EuNorth1, EuSouth1, EuSouth2, EuWest1,
+    EuWest2, EuWest3, IlCentral1, MeCentral1, MeSouth1, SaEast1, UsEast1, UsEast2, UsWest1, UsWest2
+};
+
+BSON_DEFINE_ENUM(Region, AfSouth1, ApEast1, ApNortheast1, ApNortheast2, ApNortheast3, ApSouth1, ApSouth2, ApSoutheast1, ApSoutheast2,
+                 ApSoutheast3, ApSoutheast4, CaCentral1, CaWest1, EuCentral1, EuCentral2, EuNorth1, EuSouth1, EuSouth2, EuWest1,
+                 EuWest2, EuWest3, IlCentral1, MeCentral1, MeSouth1, SaEast1, UsEast1, UsEast2, UsWest1, UsWest2)
+
+TEST(EnumTest, Serialization)
+{
+    struct Account
+    {
+        Priority priority;
+        Status status;
+        std::vector<Status> history;
+        std::optional<Region> region;
+
+        BSON_DEFINE_TYPE(Account, priority, status, history, region)
+    };
+
+    const auto bson = Account::toBSON(Account{Priority::High, Status::Suspended, {Status::Active, Status::Deleted}, UsWest2});
+
+    ASSERT_EQ(bson["priority"].get_int32().value, 2);
+    ASSERT_EQ(std::string(bson["status"].get_string().value), "Suspended");
+    ASSERT_EQ(std::string(bson["history"].get_array().value[1].get_string().value), "Deleted");
+    ASSERT_EQ(std::string(bson["region"].get_string().value), "UsWest2");
+}
+
+TEST(EnumTest, Deserialization)
+{
+    struct Account
+    {
+        Priority priority;
+        Status status;
+        std::vector<Status> history;
+        std::optional<Region> region;
+        std::vector<Region> replicas;
+
+        BSON_DEFINE_TYPE(Account, priority, status, history, region, replicas)
+    };
+
+    Account account{Priority::Medium, Status::Deleted, {Status::Active, Status::Suspended}, std::nullopt, {}};
+    for (int region = AfSouth1; region <= UsWest2; ++region)
+    {
+        account.replicas.push_back(static_cast<Region>(region));
+    }
+
+    const auto deserialized = Account::fromBSON(Account::toBSON(account));
+
+    ASSERT_EQ(deserialized.priority, Priority::Medium);
+    ASSERT_EQ(deserialized.status, Status::Deleted);
+    ASSERT_EQ(deserialized.history, account.history);
+    ASSERT_EQ(deserialized.region, std::nullopt);
+    ASSERT_EQ(deserialized.replicas, account.replicas);
+
+    bsoncxx::builder::basic::document doc{};
+    doc.append(bsoncxx::builder::basic::kvp("status", "Archived"));
+    ASSERT_THROW(Account::fromBSON(doc.view()), std::invalid_argument);
+}
+
+TEST(ColumnarTest, DecodeColumns)
+{
+    struct Reading
+    {
+        int sensor;
+        double value;
+        std::optional<double> calibrated;
+        std::string location;
+        bool alarm;
+        std::optional<bool> acknowledged;
+
+        BSON_DEFINE_TYPE(Reading, sensor, value, calibrated, location, alarm, acknowledged)
+    };
+
+    std::vector<bsoncxx::document::value> documents;
+    for (int i = 0; i < 70; ++i)
+    {
+        std::optional<double> calibrated;
+        if (i % 3 == 0)
+        {
+            calibrated = i * 0.5;
+        }
+        std::optional<bool> acknowledged;
+        if (i % 2 == 0)
+        {
+            acknowledged = i % 4 == 0;
+        }
+        documents.push_back(Reading::toBSON(Reading{i, i * 1.5, calibrated, "room", i % 5 == 0, acknowledged}));
+    }
+    bsoncxx::builder::basic::document partial{};
+    partial.append(bsoncxx::builder::basic::kvp("value", 99.0));
+    documents.push_back(partial.extract());
+
+    auto sensor = BSON_COLUMN(Reading, sensor);
+    auto value = BSON_COLUMN(Reading, value);
+    auto calibrated = BSON_COLUMN(Reading, calibrated);
+    auto alarm = BSON_COLUMN(Reading, alarm);
+    auto acknowledged = BSON_COLUMN(Reading, acknowledged);
+    decodeColumns(documents, sensor, value, calibrated, alarm, acknowledged);
+    static_assert(std::is_same_v<decltype(alarm.values()), const std::vector<std::uint8_t>&>);
+
+    ASSERT_EQ(sensor.size(), 71u);
+    ASSERT_EQ(value.size(), 71u);
+    ASSERT_EQ(calibrated.size(), 71u);
+    ASSERT_EQ(calibrated.validity().size(), 2u);
+    for (int i = 0; i < 70; ++i)
+    {
+        ASSERT_EQ(sensor[i], i);
+        ASSERT_EQ(value[i], i * 1.5);
+        ASSERT_EQ(calibrated.hasValue(i), i % 3 == 0);
+        if (i % 3 == 0)
+        {
+            ASSERT_EQ(calibrated[i], i * 0.5);
+        }
+        ASSERT_EQ(alarm[i], i % 5 == 0);
+        ASSERT_EQ(acknowledged.hasValue(i), i % 2 == 0);
+        if (i % 2 == 0)
+        {
+            ASSERT_EQ(acknowledged[i], i % 4 == 0);
+        }
+    }
+    ASSERT_EQ(sensor[70], 0);
+    ASSERT_EQ(value[70], 99.0);
+    ASSERT_FALSE(calibrated.hasValue(70));
+    ASSERT_FALSE(alarm[70]);
+    ASSERT_EQ(alarm.values().size(), 71u);
+}
+
+TEST(ColumnarTest, FailedDocumentKeepsColumnsAligned)
+{
+    const auto makeDocument = [](int a, std::optional<int> c, int b)
+    {
+        bsoncxx::builder::basic::document doc{};
+        doc.append(bsoncxx::builder::basic::kvp("a", a));
+        if (c)
+        {
+            doc.append(bsoncxx::builder::basic::kvp("c", *c));
+        }
+        doc.append(bsoncxx::builder::basic::kvp("b", b));
+        return doc.extract();
+    };
+
+    std::vector<bsoncxx::document::value> documents;
+    for (int i = 0; i < 65; ++i)
+    {
+        documents.push_back(makeDocument(i, i, i));
+    }
+    bsoncxx::builder::basic::document bad{};
+    bad.append(bsoncxx::builder::basic::kvp("a", 1));
+    bad.append(bsoncxx::builder::basic::kvp("c", 1));
+    bad.append(bsoncxx::builder::basic::kvp("b", "str"));
+    documents.push_back(bad.extract());
+
+    BsonColumn<int> a("a");
+    BsonColumn<int> b("b");
+    BsonColumn<std::optional<int>> c("c");
+    ASSERT_ANY_THROW(decodeColumns(documents, a, c, b));
+    ASSERT_EQ(a.size(), 65u);
+    ASSERT_EQ(b.size(), 65u);
+    ASSERT_EQ(c.size(), 65u);
+
+    const std::vector<bsoncxx::document::value> next{makeDocument(7, std::nullopt, 8)};
+    decodeColumns(next, a, c, b);
+    ASSERT_EQ(a[65], 7);
+    ASSERT_EQ(b[65], 8);
+    ASSERT_FALSE(c.hasValue(65));
+    ASSERT_TRUE(c.hasValue(64));
+}
+
+TEST(StreamParserTest, ArbitraryChunks)
+{
+    struct Message
+    {
+        int id;
+        std::string text;
+
+        BSON_DEFINE_TYPE(Message, id, text)
+    };
+
+    std::vector<std::uint8_t> stream;
+    for (int i = 0; i < 5; ++i)
+    {
+        const auto bson = Message::toBSON(Message{i, std::string(i * 7, 'x')});
+        stream.insert(stream.end(), bson.view().data(), bson.view().data() + bson.view().length());
+    }
+
+    for (const std::size_t chunkSize : {std::size_t{1}, std::size_t{3}, std::size_t{7}, std::size_t{64}, stream.size()})
+    {
+        BsonStreamParser<Message> parser;
+        std::vector<Message> messages;
+        for (std::size_t pos = 0; pos < stream.size(); pos += chunkSize)
+        {
+            const auto size = std::min(chunkSize, stream.size() - pos);
+            parser.feed(stream.data() + pos, size, [&messages](Message message) { messages.push_back(std::move(message)); });
+        }
+
+        ASSERT_FALSE(parser.hasPartialDocument());
+        ASSERT_EQ(messages.size(), 5u);
+        for (int i = 0; i < 5; ++i)
+        {
+            ASSERT_EQ(messages[i].id, i);
+            ASSERT_EQ(messages[i].text, std::string(i * 7, 'x'));
+        }
+    }
+}
+
+TEST(StreamParserTest, ViewsIntoChunk)
+{
+    bsoncxx::builder::basic::document doc{};
+    doc.append(bsoncxx::builder::basic::kvp("n", 1));
+    const auto value = doc.extract();
+
+    std::vector<std::uint8_t> chunk(value.view().data(), value.view().data() + value.view().length());
+    chunk.insert(chunk.end(), value.view().data(), value.view().data() + 6);
+
+    BsonDocumentStream stream;
+    std::vector<const std::uint8_t*> seen;
+    ASSERT_EQ(stream.feed(chunk.data(), chunk.size(), [&seen](const bsoncxx::document::view& view) { seen.push_back(view.data()); }), 1u);
+    ASSERT_EQ(seen.front(), chunk.data());
+    ASSERT_EQ(stream.bufferedBytes(), 6u);
+
+    const std::uint8_t corrupt[] = {2, 0, 0, 0};
+    BsonDocumentStream corrupted;
+    ASSERT_THROW(corrupted.feed(corrupt, sizeof(corrupt), [](const bsoncxx::document::view&) {}), std::invalid_argument);
+}
+
+TEST(StreamParserTest, ResumesAfterFailedDocument)
+{
+    struct Message
+    {
+        int id;
+
+        BSON_DEFINE_TYPE(Message, id)
+    };
+
+    bsoncxx::builder::basic::document wrongType{};
+    wrongType.append(bsoncxx::builder::basic::kvp("id", "not a number"));
+    const auto bad = wrongType.extract();
+
+    std::vector<std::uint8_t> chunk;
+    const auto append = [&chunk](const bsoncxx::document::view& view, std::size_t length)
+    {
+        chunk.insert(chunk.end(), view.data(), view.data() + length);
+    };
+    const auto first = Message::toBSON(Message{1});
+    const auto third = Message::toBSON(Message{3});
+    const auto fourth = Message::toBSON(Message{4});
+    append(first.view(), first.view().length());
+    append(bad.view(), bad.view().length());
+    append(third.view(), third.view().length());
+    append(fourth.view(), 6);
+
+    BsonStreamParser<Message> parser;
+    std::vector<int> ids;
+    const auto onMessage = [&ids](const Message& message) { ids.push_back(message.id); };
+
+    ASSERT_ANY_THROW(parser.feed(chunk.data(), chunk.size(), onMessage));
+    ASSERT_EQ(ids, std::vector<int>{1});
+    ASSERT_TRUE(parser.hasPartialDocument());
+
+    // the next chunk resumes with the document after the failed one
+    ASSERT_EQ(parser.feed(fourth.view().data() + 6, fourth.view().length() - 6, onMessage), 2u);
+    ASSERT_EQ(ids, (std::vector<int>{1, 3, 4}));
+    ASSERT_FALSE(parser.hasPartialDocument());
+}
+
+TEST(StreamParserTest, RejectsInputAfterInvalidLength)
+{
+    bsoncxx::builder::basic::document doc{};
+    doc.append(bsoncxx::builder::basic::kvp("n", 1));
+    const auto value = doc.extract();
+
+    std::vector<std::uint8_t> chunk(8, 0);
+    chunk[0] = 0xFF;
+    chunk[1] = 0xFF;
+    chunk[2] = 0xFF;
+    chunk[3] = 0x7F;
+    const std::vector<std::uint8_t> garbage(1000, 0xAB);
+
+    BsonDocumentStream stream;
+    std::size_t documents = 0;
+    const auto onDocument = [&documents](const bsoncxx::document::view&) { ++documents; };
+
+    ASSERT_THROW(stream.feed(chunk.data(), chunk.size(), onDocument), std::invalid_argument);
+    ASSERT_TRUE(stream.failed());
+    for (int i = 0; i < 5; ++i)
+    {
+        ASSERT_THROW(stream.feed(garbage.data(), garbage.size(), onDocument), std::invalid_argument);
+        ASSERT_EQ(stream.bufferedBytes(), 0u);
+    }
+
+    // a length prefix completed by a later chunk fails the same way
+    BsonDocumentStream split;
+    split.feed(chunk.data(), 2, onDocument);
+    ASSERT_THROW(split.feed(chunk.data() + 2, chunk.size() - 2, onDocument), std::invalid_argument);
+    ASSERT_TRUE(split.failed());
+    ASSERT_EQ(split.bufferedBytes(), 0u);
+
+    stream.reset();
+    ASSERT_FALSE(stream.failed());
+    ASSERT_EQ(stream.feed(value.view().data(), value.view().length(), onDocument), 1u);
+    ASSERT_EQ(documents, 1u);
+}
+
+TEST(CompactProfileTest, Serialization)
+{
+    struct Reading
+    {
+        int sensor;
+        double value;
+        std::optional<std::string> note;
+        std::optional<int> flags;
+
+        BSON_DEFINE_COMPACT_TYPE(Reading, (sensor, "s"), (value, "v"), note, (flags, "f"))
+    };
+
+    // BSON_DEFINE_COMPACT_TYPE rejects key lists like these with a static_assert
+    static_assert(bsonHasDuplicateKeys(makeBsonKeys(BsonMembersBegin{}, "s", "v", "s")));
+    static_assert(bsonHasDuplicateKeys(makeBsonKeys(BsonMembersBegin{}, "note", "v", "note")));
+    static_assert(!bsonHasDuplicateKeys(makeBsonKeys(BsonMembersBegin{}, "s", "v", "note", "f")));
+
+    struct FullReading
+    {
+        int sensor;
+        double value;
+        std::optional<std::string> note;
+        std::optional<int> flags;
+
+        BSON_DEFINE_TYPE(FullReading, sensor, value, note, flags)
+    };
+
+    const auto bson = Reading::toBSON(Reading{3, 1.5, std::nullopt, 4});
+    const auto view = bson.view();
+
+    ASSERT_EQ(view["s"].get_int32().value, 3);
+    ASSERT_EQ(view["v"].get_double().value, 1.5);
+    ASSERT_EQ(view["f"].get_int32().value, 4);
+    ASSERT_TRUE(view.find("note") == view.end());
+    ASSERT_TRUE(view.find("sensor") == view.end());
+    ASSERT_LT(view.length(), FullReading::toBSON(FullReading{3, 1.5, std::nullopt, 4}).view().length());
+
+    static_assert(Reading::bsonKey("value") == "v");
+    static_assert(Reading::bsonKey("note") == "note");
+    static_assert(FullReading::bsonKey("value") == "value");
+}
+
+TEST(CompactProfileTest, Deserialization)
+{
+    struct Reading
+    {
+        struct Location
+        {
+            double lat;
+            double lon;
+
+            BSON_DEFINE_COMPACT_TYPE(Location, (lat, "a"), (lon, "o"))
+        };
+
+        int sensor;
+        std::optional<std::string> note;
+        std::optional<Location> location;
+        std::vector<Location> path;
+
+        BSON_DEFINE_COMPACT_TYPE(Reading, (sensor, "s"), (note, "n"), (location, "l"), (path, "p"))
+    };
+
+    Reading reading{7, "ok", std::nullopt, {{1.0, 2.0}, {3.0, 4.0}}};
+    const auto bson = Reading::toBSON(reading);
+    const auto deserialized = Reading::fromBSON(bson);
+
+    ASSERT_EQ(deserialized.sensor, 7);
+    ASSERT_EQ(deserialized.note, "ok");
+    ASSERT_EQ(deserialized.location.has_value(), false);
+    ASSERT_EQ(deserialized.path.size(), 2u);
+    ASSERT_EQ(deserialized.path[1].lon, 4.0);
+    ASSERT_EQ(bson["p"].get_array().value[0]["a"].get_double().value, 1.0);
+
+    auto sensor = BSON_COLUMN(Reading, sensor);
+    decodeColumns(std::vector<bsoncxx::document::view>{bson.view()}, sensor);
+    ASSERT_EQ(sensor[0], 7);
+}
+
+TEST(AllocatorTest, DecodeIntoMemoryResource)
+{
+    struct Tag
+    {
+        std::pmr::string name;
+        std::pmr::vector<int> weights;
+
+        BSON_DEFINE_TYPE(Tag, name, weights)
+    };
+
+    struct Request
+    {
+        std::pmr::string path;
+        std::optional<std::pmr::string> referrer;
+        std::pmr::vector<std::pmr::string> headers;
+        std::pmr::vector<Tag> tags;
+        Tag primary;
+        std::string plain;
+
+        BSON_DEFINE_TYPE(Request, path, referrer, headers, tags, primary, plain)
+    };
+
+    const char* longText = "a string long enough to need a heap allocation";
+    Request request;
+    request.path = longText;
+    request.referrer = longText;
+    request.headers = {std::pmr::string(longText), std::pmr::string(longText)};
+    request.tags.push_back(Tag{std::pmr::string(longText), {1, 2, 3}});
+    request.primary = Tag{std::pmr::string(longText), {4}};
+    request.plain = "plain";
+    const auto bson = Request::toBSON(request);
+
+    std::array<std::byte, 16 * 1024> buffer;
+    std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+    // every pmr allocation must come from the arena
+    auto* previous = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+    const auto deserialized = Request::fromBSON(bson, &arena);
+    std::pmr::set_default_resource(previous);
+
+    ASSERT_EQ(deserialized.path, longText);
+    ASSERT_EQ(deserialized.referrer.value(), longText);
+    ASSERT_EQ(deserialized.headers.size(), 2u);
+    ASSERT_EQ(deserialized.tags[0].weights[2], 3);
+    ASSERT_EQ(deserialized.primary.name, longText);
+    ASSERT_EQ(deserialized.plain, "plain");
+    ASSERT_EQ(deserialized.path.get_allocator().resource(), &arena);
+    ASSERT_EQ(deserialized.referrer->get_allocator().resource(), &arena);
+    ASSERT_EQ(deserialized.headers.get_allocator().resource(), &arena);
+    ASSERT_EQ(deserialized.headers[1].get_allocator().resource(), &arena);
+    ASSERT_EQ(deserialized.tags[0].name.get_allocator().resource(), &arena);
+    ASSERT_EQ(deserialized.primary.weights.get_allocator().resource(), &arena);
+
+    const auto name = get<std::pmr::string>(bson.view()["path"], &arena);
+    ASSERT_EQ(name.get_allocator().resource(), &arena);
+
+    const auto defaultDecoded = Request::fromBSON(bson);
+    ASSERT_EQ(defaultDecoded.headers[0], longText);
+    ASSERT_EQ(defaultDecoded.path.get_allocator().resource(), std::pmr::get_default_resource());
+}
+
+TEST(RawDocumentTest, PassThrough)
+{
+    struct Metadata
+    {
+        std::string owner;
+        std::vector<int> scores;
+
+        BSON_DEFINE_TYPE(Metadata, owner, scores)
+    };
+
+    struct Envelope
+    {
+        int id;
+        BsonRawDocument metadata;
+        BsonRawDocument tags;
+        std::optional<bsoncxx::document::value> extra;
+        std::vector<BsonRawDocument> items;
+
+        BSON_DEFINE_TYPE(Envelope, id, metadata, tags, extra, items)
+    };
+
+    bsoncxx::builder::basic::array tags;
+    tags.append("a", "b");
+
+    bsoncxx::builder::basic::document source{};
+    source.append(bsoncxx::builder::basic::kvp("id", 1));
+    source.append(bsoncxx::builder::basic::kvp("metadata", Metadata::toBSON(Metadata{"alice", {1, 2}}).view()));
+    source.append(bsoncxx::builder::basic::kvp("tags", tags.view()));
+    source.append(bsoncxx::builder::basic::kvp("extra", Metadata::toBSON(Metadata{"bob", {}}).view()));
+    bsoncxx::builder::basic::array items;
+    items.append(Metadata::toBSON(Metadata{"carol", {3}}).view(), tags.view());
+    source.append(bsoncxx::builder::basic::kvp("items", items.view()));
+    const auto bson = source.extract();
+
+    const auto envelope = Envelope::fromBSON(bson);
+    ASSERT_FALSE(envelope.metadata.isArray());
+    ASSERT_TRUE(envelope.tags.isArray());
+    ASSERT_EQ(envelope.metadata.size(), bson["metadata"].get_document().view().length());
+    ASSERT_EQ(Metadata::fromBSON(envelope.metadata.view()).owner, "alice");
+    ASSERT_EQ(Metadata::fromBSON(envelope.extra.value().view()).owner, "bob");
+    ASSERT_EQ(Metadata::fromBSON(envelope.items[0].view()).scores[0], 3);
+    ASSERT_TRUE(envelope.items[1].isArray());
+
+    const auto reencoded = Envelope::toBSON(envelope);
+    ASSERT_EQ(reencoded.view().length(), bson.view().length());
+    ASSERT_EQ(std::memcmp(reencoded.view().data(), bson.view().data(), bson.view().length()), 0);
+
+    const auto view = get<bsoncxx::document::view>(bson["metadata"]);
+    ASSERT_EQ(view.data(), bson["metadata"].get_document().view().data());
+    const auto arr = get<bsoncxx::array::value>(bson["tags"]);
+    ASSERT_EQ(arr.view().length(), tags.view().length());
+}
+
+namespace
+{
+    struct LiteralPoint
+    {
+        int x;
+        int y;
+
+        BSON_DEFINE_TYPE(LiteralPoint, x, y)
+        BSON_DEFINE_LITERAL(LiteralPoint, x, y)
+    };
+
+    struct LiteralSpec
+    {
+        double limit;
+        bool active;
+        int64_t since;
+        LiteralPoint origin;
+
+        BSON_DEFINE_TYPE(LiteralSpec, limit, active, since, origin)
+        BSON_DEFINE_LITERAL(LiteralSpec, limit, active, since, origin)
+    };
+}
+
+TEST(LiteralTest, MatchesRuntimeEncoding)
+{
+    static constexpr auto filter = bsonLiteral(
+        bsonField("status", "active"),
+        bsonField("age", 30),
+        bsonField("score", -2.75),
+        bsonField("tiny", 4.9406564584124654e-324),
+        bsonField("big", int64_t{1} << 40),
+        bsonField("deleted", false),
+        bsonField("parent", std::nullopt),
+        bsonField("range", bsonLiteral(bsonField("min", 1), bsonField("max", 0.1))),
+        bsonField("tags", bsonArray("a", "b", 1, 2, 3, 4, 5, 6, 7, 8, 9, 10)));
+    static_assert(filter.bytes[0] == filter.size);
+
+    bsoncxx::builder::basic::document range{};
+    range.append(bsoncxx::builder::basic::kvp("min", 1), bsoncxx::builder::basic::kvp("max", 0.1));
+    bsoncxx::builder::basic::array tags;
+    tags.append("a", "b");
+    for (int i = 1; i <= 10; ++i)
+    {
+        tags.append(i);
+    }
+    bsoncxx::builder::basic::document expected{};
+    expected.append(bsoncxx::builder::basic::kvp("status", "active"));
+    expected.append(bsoncxx::builder::basic::kvp("age", 30));
+    expected.append(bsoncxx::builder::basic::kvp("score", -2.75));
+    expected.append(bsoncxx::builder::basic::kvp("tiny", 4.9406564584124654e-324));
+    expected.append(bsoncxx::builder::basic::kvp("big", int64_t{1} << 40));
+    expected.append(bsoncxx::builder::basic::kvp("deleted", false));
+    expected.append(bsoncxx::builder::basic::kvp("parent", bsoncxx::types::b_null{}));
+    expected.append(bsoncxx::builder::basic::kvp("range", range.view()));
+    expected.append(bsoncxx::builder::basic::kvp("tags", tags.view()));
+    const auto bson = expected.extract();
+
+    ASSERT_EQ(filter.view().length(), bson.view().length());
+    ASSERT_EQ(std::memcmp(filter.view().data(), bson.view().data(), bson.view().length()), 0);
+    ASSERT_EQ(filter.view()["tags"].get_array().value[11].get_int32().value, 10);
+}
+
+TEST(LiteralTest, DefinedType)
+{
+    static constexpr auto spec = LiteralSpec::toBSONLiteral(LiteralSpec{1e6, true, -5, LiteralPoint{3, 4}});
+    const auto bson = LiteralSpec::toBSON(LiteralSpec{1e6, true, -5, LiteralPoint{3, 4}});
+
+    ASSERT_EQ(spec.view().length(), bson.view().length());
+    ASSERT_EQ(std::memcmp(spec.view().data(), bson.view().data(), bson.view().length()), 0);
+    ASSERT_EQ(LiteralSpec::fromBSON(spec.view()).origin.y, 4);
+}
+
+TEST(FixedLayoutTest, EncodeAndDecode)
+{
+    struct Telemetry
+    {
+        bsoncxx::oid _id;
+        int32_t sensor;
+        int64_t sequence;
+        double value;
+        bool alarm;
+        Priority priority;
+        std::chrono::system_clock::time_point at;
+
+        BSON_DEFINE_TYPE(Telemetry, _id, sensor, sequence, value, alarm, priority, at)
+    };
+
+    struct Named
+    {
+        int32_t sensor;
+        std::string name;
+
+        BSON_DEFINE_TYPE(Named, sensor, name)
+    };
+
+    static_assert(bsonIsFixedLayout<Telemetry>());
+    static_assert(!bsonIsFixedLayout<Named>());
+
+    const auto at = std::chrono::system_clock::time_point(std::chrono::milliseconds(1700000000123));
+    const Telemetry telemetry{bsoncxx::oid(), 7, int64_t{1} << 40, -3.5, true, Priority::High, at};
+
+    bsoncxx::builder::basic::document expected{};
+    expected.append(bsoncxx::builder::basic::kvp("_id", telemetry._id));
+    expected.append(bsoncxx::builder::basic::kvp("sensor", 7));
+    expected.append(bsoncxx::builder::basic::kvp("sequence", int64_t{1} << 40));
+    expected.append(bsoncxx::builder::basic::kvp("value", -3.5));
+    expected.append(bsoncxx::builder::basic::kvp("alarm", true));
+    expected.append(bsoncxx::builder::basic::kvp("priority", static_cast<int32_t>(Priority::High)));
+    expected.append(bsoncxx::builder::basic::kvp("at", bsoncxx::types::b_date{at}));
+    const auto expectedBson = expected.extract();
+
+    const auto bson = Telemetry::toBSON(telemetry);
+    ASSERT_EQ(bson.view().length(), expectedBson.view().length());
+    ASSERT_EQ(std::memcmp(bson.view().data(), expectedBson.view().data(), bson.view().length()), 0);
+
+    const auto decoded = Telemetry::fromBSON(bson);
+    ASSERT_TRUE(decoded._id == telemetry._id);
+    ASSERT_EQ(decoded.sequence, telemetry.sequence);
+    ASSERT_EQ(decoded.value, -3.5);
+    ASSERT_EQ(decoded.alarm, true);
+    ASSERT_EQ(decoded.priority, Priority::High);
+    ASSERT_TRUE(decoded.at == at);
+
+    // a different layout falls back to the general path
+    bsoncxx::builder::basic::document reordered{};
+    reordered.append(bsoncxx::builder::basic::kvp("value", 2.5));
+    reordered.append(bsoncxx::builder::basic::kvp("sensor", 9));
+    const auto fallback = Telemetry::fromBSON(reordered.extract());
+    ASSERT_EQ(fallback.sensor, 9);
+    ASSERT_EQ(fallback.value, 2.5);
+    ASSERT_EQ(fallback.sequence, 0);
+}
@@ -0,0 +1,74 @@
+#include "cpp-bson-dump-index.hpp"
+
+#include <bsoncxx/json.hpp>
+#include <cstdlib>
+#include <iostream>
+
+namespace
+{
+    int usage()
+    {
+        std::cerr << "usage: bson-dump-index build <dump.bson> [index] [threads]\n"
+                  << "       bson-dump-index find <dump.bson> <index> <_id>\n"
+                  << "_id is an ObjectId as 24 hex digits, or an integer\n";
+        return 2;
+    }
+
+    template <typename Key>
+    int printDocument(const BsonDumpIndex& index, const Key& id)
+    {
+        const auto doc = index.find(id);
+        if (!doc)
+        {
+            std::cerr << "not found\n";
+            return 1;
+        }
+        std::cout << bsoncxx::to_json(*doc) << "\n";
+        return 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        return usage();
+    }
+
+    const std::string command = argv[1];
+    const std::string dumpPath = argv[2];
+    try
+    {
+        BsonDumpIndex index(dumpPath);
+        if (command == "build")
+        {
+            const std::string indexPath = argc > 3 ? argv[3] : dumpPath + ".idx";
+            const unsigned threads = argc > 4 ? static_cast<unsigned>(std::strtoul(argv[4], nullptr, 10)) : 0;
+            index.build(threads);
+            index.save(indexPath);
+            std::cout << index.size() << " documents indexed to " << indexPath << "\n";
+            return 0;
+        }
+        if (command == "find" && argc > 4)
+        {
+            index.load(argv[3]);
+            const std::string id = argv[4];
+            if (id.size() == 24 && id.find_first_not_of("0123456789abcdefABCDEF") == std::string::npos)
+            {
+                return printDocument(index, bsoncxx::oid(id));
+            }
+            const auto value = std::stoll(id);
+            if (value >= INT32_MIN && value <= INT32_MAX)
+            {
+                return printDocument(index, static_cast<int32_t>(value));
+            }
+            return printDocument(index, static_cast<int64_t>(value));
+        }
+        return usage();
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,81 @@
+#include "cpp-bson-convert.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct Order
+    {
+        int id;
+        std::string customer;
+        std::string comment;
+        double total;
+        bool paid;
+        std::vector<std::string> items;
+
+        BSON_DEFINE_TYPE(Order, id, customer, comment, total, paid, items)
+    };
+
+    /// Best time per call over a few rounds, so that noise from other processes does not skew the comparison
+    template <typename Function>
+    double nanosecondsPerDocument(std::size_t iterations, Function&& function)
+    {
+        double best = 0;
+        for (int round = 0; round < 5; ++round)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < iterations; ++i)
+            {
+                function();
+            }
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            const auto perCall = std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(iterations);
+            best = round == 0 ? perCall : std::min(best, perCall);
+        }
+        return best;
+    }
+}
+
+/**
+ * Compares plain fromBSON against tryFromBSON, which validates the document in the same walk as it decodes
+ * it, and against validateBSON followed by fromBSON.
+ * usage: validation-benchmark [iterations]
+ */
+int main(int argc, char** argv)
+{
+    const std::size_t iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+
+    const Order order{42, "K\xC3\xB6ln Logistics", std::string(200, 'x') + "\xE2\x82\xAC", 199.95, true,
+                      {"keyboard", "mouse", "monitor", "cable"}};
+    const auto bson = Order::toBSON(order);
+    const auto view = bson.view();
+
+    std::size_t sink = 0;
+    const double plain = nanosecondsPerDocument(iterations, [&]
+    {
+        sink += Order::fromBSON(view).items.size();
+    });
+    const double fused = nanosecondsPerDocument(iterations, [&]
+    {
+        Order decoded{};
+        sink += tryFromBSON(view, decoded) ? decoded.items.size() : 0;
+    });
+    const double separate = nanosecondsPerDocument(iterations, [&]
+    {
+        if (validateBSON(view.data(), view.length()))
+        {
+            sink += Order::fromBSON(view).items.size();
+        }
+    });
+
+    std::cout << "document size:            " << view.length() << " bytes\n"
+              << "fromBSON:                 " << plain << " ns\n"
+              << "tryFromBSON:              " << fused << " ns (+" << (fused / plain - 1.0) * 100.0 << "%)\n"
+              << "validateBSON + fromBSON:  " << separate << " ns (+" << (separate / plain - 1.0) * 100.0 << "%)\n";
+    return sink == 0;
+}